@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Compile-time field reflection for plain aggregates, no annotations needed.
+// The field count is the largest number of initializers the type accepts in
+// aggregate initialization, the field types come from a structured binding.
+// Only supports aggregates without base classes and up to 8 fields.
+
+template <typename... Types>
+struct TypeList
+{
+    static constexpr size_t size = sizeof...(Types);
+};
+
+// Converts to any field type, only ever used in unevaluated contexts
+struct AnyField
+{
+    template <typename T>
+    operator T() const;
+};
+
+template <typename T, size_t... I>
+constexpr bool isBraceConstructible(std::index_sequence<I...>)
+{
+    return requires { T{(static_cast<void>(I), AnyField{})...}; };
+}
+
+template <typename T, size_t N = 0>
+constexpr size_t aggregateFieldCount()
+{
+    static_assert(std::is_aggregate_v<T>, "Only aggregates can be reflected");
+
+    if constexpr (isBraceConstructible<T>(std::make_index_sequence<N + 1>{}))
+    {
+        return aggregateFieldCount<T, N + 1>();
+    }
+    else
+    {
+        return N;
+    }
+}
+
+// Never called, only its return type is used
+template <typename T>
+auto aggregateFieldTypes()
+{
+    constexpr size_t count = aggregateFieldCount<T>();
+    static_assert(count > 0 && count <= 8, "Reflection supports 1 to 8 fields");
+
+    T value{};
+    if constexpr (count == 1)
+    {
+        auto &[a] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>>{};
+    }
+    else if constexpr (count == 2)
+    {
+        auto &[a, b] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>>{};
+    }
+    else if constexpr (count == 3)
+    {
+        auto &[a, b, c] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>>{};
+    }
+    else if constexpr (count == 4)
+    {
+        auto &[a, b, c, d] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>>{};
+    }
+    else if constexpr (count == 5)
+    {
+        auto &[a, b, c, d, e] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>,
+                        std::remove_cvref_t<decltype(e)>>{};
+    }
+    else if constexpr (count == 6)
+    {
+        auto &[a, b, c, d, e, f] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>,
+                        std::remove_cvref_t<decltype(e)>, std::remove_cvref_t<decltype(f)>>{};
+    }
+    else if constexpr (count == 7)
+    {
+        auto &[a, b, c, d, e, f, g] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>,
+                        std::remove_cvref_t<decltype(e)>, std::remove_cvref_t<decltype(f)>,
+                        std::remove_cvref_t<decltype(g)>>{};
+    }
+    else
+    {
+        auto &[a, b, c, d, e, f, g, h] = value;
+        return TypeList<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+                        std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>,
+                        std::remove_cvref_t<decltype(e)>, std::remove_cvref_t<decltype(f)>,
+                        std::remove_cvref_t<decltype(g)>, std::remove_cvref_t<decltype(h)>>{};
+    }
+}
+
+template <typename T>
+using AggregateFields = decltype(aggregateFieldTypes<T>());
+
+// Field offsets of a standard layout aggregate follow from the field types
+// alone, each is placed at the next multiple of its alignment
+template <typename... Fields>
+constexpr auto aggregateFieldOffsets(TypeList<Fields...>)
+{
+    std::array<size_t, sizeof...(Fields) + 1> offsets{};
+    size_t offset = 0, index = 0;
+    auto place = [&](size_t size, size_t alignment)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        offsets[index++] = offset;
+        offset += size;
+    };
+    (place(sizeof(Fields), alignof(Fields)), ...);
+
+    // The end of the last field, for checking against sizeof
+    offsets[index] = offset;
+    return offsets;
+}
+
+// Offsets of T's fields, verified against the type's actual size
+template <typename T>
+constexpr auto aggregateFieldOffsets()
+{
+    static_assert(std::is_standard_layout_v<T>, "Field offsets are only known for standard layout types");
+
+    constexpr auto offsets = aggregateFieldOffsets(AggregateFields<T>{});
+    constexpr size_t end = offsets.back();
+    static_assert((end + alignof(T) - 1) / alignof(T) * alignof(T) == sizeof(T),
+                  "Field layout doesn't match the type, does it have bases or unusual attributes?");
+    return offsets;
+}
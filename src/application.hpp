@@ -14,20 +14,157 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <random>
 #include <ranges>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
+#include "deletion_queue.hpp"
+#include "entity_store.hpp"
+#include "frame_command_pool.hpp"
+#include "frame_pacing.hpp"
+#include "index_data.hpp"
+#include "job_system.hpp"
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_import.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlets.hpp"
+#include "range_allocator.hpp"
+#include "render_graph.hpp"
+#include "scene_graph.hpp"
+#include "transform_store.hpp"
+#include "triple_buffer.hpp"
+#include "vertex_formats.hpp"
+
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 const char *APP_NAME = "Hello Triangle";
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Render on a dedicated thread while the main thread handles GLFW events and
+// runs the simulation at SIMULATION_RATE (or as soon as input arrives)
+const bool enableRenderThread = true;
+const double SIMULATION_RATE = 240.0;
+
+// Record the scene once per framebuffer and replay it every frame. Buffers
+// are only re-recorded after markSceneDirty or a swapchain recreation
+const bool enableStaticScene = true;
+
+// Only produce frames while the scene animates or after input, otherwise
+// sleep in glfwWaitEventsTimeout. Rendering always pauses while minimized
+const bool enableOnDemandRendering = true;
+const bool animateScene = true;
+const double IDLE_WAIT_TIMEOUT = 0.5;
+
+// Cap the frame rate (0 = uncapped) by sleeping just before input is sampled,
+// and periodically report frame times and input to present latency. Latency
+// uses VK_KHR_present_wait when available, otherwise the CPU time at which
+// the frame was handed to the presentation engine
+const double TARGET_FRAME_RATE = 0.0;
+const bool enableFrameStats = true;
+const double FRAME_STATS_INTERVAL = 5.0;
+const uint64_t PRESENT_WAIT_TIMEOUT = 100'000'000;
+
+// Render straight into image views with vkCmdBeginRendering (Vulkan 1.3 or
+// VK_KHR_dynamic_rendering) instead of a render pass and framebuffers, with
+// barriers derived by ResourceStateTracker (needs synchronization2). Falls
+// back to the render pass path on devices without support
+const bool preferDynamicRendering = true;
+
+// Draw opaque objects front to back by a key of pipeline then view
+// depth, so the depth test rejects hidden fragments before shading. Fragment
+// shader invocations are counted with a pipeline statistics query when the
+// device supports it and reported with the frame stats
+const bool enableDrawSorting = true;
+const uint32_t SCENE_OBJECT_COUNT = 16;
+
+// Lay down depth with a depth-only pass first, then shade with an equal depth
+// test so every pixel runs the fragment shader once. Pays off for expensive
+// fragment shaders. P toggles it at runtime to compare fragment invocations
+const bool enableDepthPrepass = false;
+
+// Layout the scene's vertices are packed into on upload, one of Vertex,
+// HalfVertex or Snorm16Vertex
+using SceneVertex = Snorm16Vertex;
+
+// Mesh drawn for every scene object, an .obj or .glb file scaled to unit size
+// around the origin. Vertices are deduplicated and reordered for the vertex
+// cache on load. Empty draws the built-in quad
+const char *MODEL_PATH = "";
+
+// Keep imported meshes in a binary cache keyed by the source file's hash, so
+// later runs map the optimized mesh instead of parsing and optimizing again
+const bool enableMeshCache = true;
+const char *MESH_CACHE_DIR = "mesh_cache";
+
+// Every mesh lives in one shared vertex buffer and one shared index buffer,
+// in ranges handed out by a suballocator. Draws select their mesh with
+// vertexOffset and firstIndex so buffers are bound once per pass, and all of
+// a pass's draws go out as one multi-draw indirect call where supported.
+// Each mesh keeps the smallest index type that addresses its vertices, so the
+// index buffer is bound, and the multi-draw split, once per index type in
+// use. Sizes are in vertices and 32-bit indices, grown to fit the scene mesh
+// if needed
+const uint32_t GEOMETRY_BUFFER_VERTICES = 1 << 20;
+const uint32_t GEOMETRY_BUFFER_INDICES = 1 << 22;
+
+// Imported meshes get a chain of coarser levels of detail by quadric error
+// edge collapse, stored after the full mesh in the geometry buffers. Each
+// object draws the coarsest level whose error covers at most LOD_ERROR_PIXELS
+// on screen. MAX_LOD_ERROR is in the unit-size mesh's units
+const bool enableMeshLods = true;
+const uint32_t MAX_MESH_LODS = 6;
+const float MAX_LOD_ERROR = 0.05f;
+const float LOD_ERROR_PIXELS = 1.0f;
+
+// Meshes are split into meshlets of consecutive triangles with bounding
+// spheres and normal cones. A compute pass culls each object's meshlets
+// against the frustum and by facing, and writes one indirect draw per meshlet
+// with no instances when culled. Needs multiDrawIndirect, otherwise objects
+// are drawn whole
+const bool enableMeshletCulling = true;
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+const uint32_t GEOMETRY_BUFFER_MESHLETS = 1 << 16;
+
+// Objects hidden behind what was drawn the frame before are culled as well.
+// The previous frame's depth is reduced into a pyramid of farthest depths,
+// which the meshlet cull tests each object's bounding sphere against. Needs
+// meshlet culling, the render graph and a depth format without stencil
+const bool enableOcclusionCulling = true;
+
+// Object transforms live in a structure of arrays and are turned into model
+// matrices and world space boxes 4 (SSE2) or 8 (AVX2) at a time, in batches
+// of TRANSFORM_BATCH_SIZE objects spread over the job system. Objects whose
+// box lies outside the frustum are dropped before sorting. The startup
+// benchmarks time the scalar and SIMD kernels over
+// TRANSFORM_BENCHMARK_OBJECTS random objects
+const bool enableFrustumCulling = true;
+const uint32_t TRANSFORM_BATCH_SIZE = 1024;
+const uint32_t TRANSFORM_BENCHMARK_OBJECTS = 100'000;
+
+// Time engine code against simpler alternatives once at startup and print
+// the results: the transform and culling kernels scalar against SIMD (see
+// above), the job system against a single mutex protected queue, for
+// JOB_BENCHMARK_JOBS tiny jobs, and resetting a frame's command pool against
+// resetting each of COMMAND_BENCHMARK_BUFFERS command buffers on their own
+const bool enableStartupBenchmarks = false;
+const uint32_t JOB_BENCHMARK_JOBS = 100'000;
+const uint32_t COMMAND_BENCHMARK_BUFFERS = 64;
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -46,43 +183,183 @@ struct QueueFamilyIndices
     uint32_t presentFamily;
 };
 
+// Features used when the device supports them
+struct OptionalDeviceFeatures
+{
+    bool presentWait = false;
+    bool dynamicRendering = false;
+    bool synchronization2 = false;
+    bool pipelineStatistics = false;
+    bool indexTypeUint8 = false;
+    bool multiDrawIndirect = false;
+};
+
 struct UniformBufferObject
 {
-   alignas(16) glm::mat4 model;
    alignas(16) glm::mat4 view;
    alignas(16) glm::mat4 proj;
 };
 
-struct Vertex
+// Everything the renderer needs from the simulation for one frame
+struct FrameSnapshot
+{
+    std::chrono::steady_clock::time_point inputTime;
+    vk::Extent2D framebufferExtent;
+    UniformBufferObject ubo;
+
+    // Per renderable entity, in EntityStore::forEach order. Snapshots are
+    // reused, captureFrameSnapshot only copies the transform and box of
+    // objects whose entity or scene graph version changed
+    std::vector<Entity> objectEntities;
+    std::vector<uint32_t> objectMeshes;
+    std::vector<uint32_t> objectMaterials;
+    std::vector<glm::mat4> objectTransforms;
+    BoxBounds objectBounds;
+    std::vector<uint64_t> objectVersions;
+
+    // Time the scene graph update and copying out of it took
+    DurationSummary::Duration transformTime;
+};
+
+// What a frame slot's instance buffer holds at one position, it is only
+// rewritten when any of this changes
+struct UploadedInstance
+{
+    Entity entity;
+    uint32_t mesh = UINT32_MAX;
+    uint64_t version = 0;
+};
+
+// Components of entities the renderer draws. Transform and bounds live in the
+// scene graph, the entity refers to its node
+struct SceneNodeComponent
+{
+    uint32_t node;
+};
+
+// Finest level of detail in Application::meshes
+struct MeshComponent
+{
+    uint32_t mesh;
+};
+
+// Index into Application::materials
+struct MaterialComponent
+{
+    uint32_t material;
+};
+
+struct Material
+{
+    uint32_t pipeline;
+};
+
+// Sorted per frame, the key puts draws with the same pipeline together, then
+// those with the same index type, and orders them front to back within that
+struct DrawItem
+{
+    uint64_t sortKey;
+    uint32_t object;
+    uint32_t mesh;
+};
+
+// Consecutive sorted draws sharing a pipeline and mesh, drawn as one
+// instanced draw
+struct DrawBatch
+{
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+
+    bool operator==(const DrawBatch &) const = default;
+};
+
+// Consecutive indirect draws whose meshes share an index type, drawn after
+// one index buffer bind
+struct IndexTypeRun
 {
-    glm::vec2 pos;
-    glm::vec3 color;
+    vk::IndexType indexType;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+
+    bool operator==(const IndexTypeRun &) const = default;
+};
 
-    static std::array<vk::VertexInputBindingDescription, 1> getBindingDescriptions()
+inline void appendIndexTypeRun(std::vector<IndexTypeRun> &runs, vk::IndexType indexType, uint32_t drawCount)
+{
+    if (drawCount == 0)
     {
-        return {vk::VertexInputBindingDescription{
-            .binding = 0,
-            .stride = sizeof(Vertex),
-            .inputRate = vk::VertexInputRate::eVertex,
-        }};
+        return;
     }
-
-    static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions()
+    if (!runs.empty() && runs.back().indexType == indexType)
     {
-        vk::VertexInputAttributeDescription posDescription{
-            .location = 0,
-            .binding = 0,
-            .format = vk::Format::eR32G32Sfloat,
-            .offset = offsetof(Vertex, pos),
-        };
-        vk::VertexInputAttributeDescription colorDescription{
-            .location = 1,
-            .binding = 0,
-            .format = vk::Format::eR32G32B32Sfloat,
-            .offset = offsetof(Vertex, color),
-        };
-        return std::array{posDescription, colorDescription};
+        runs.back().drawCount += drawCount;
+        return;
     }
+    uint32_t firstDraw = runs.empty() ? 0 : runs.back().firstDraw + runs.back().drawCount;
+    runs.push_back({.indexType = indexType, .firstDraw = firstDraw, .drawCount = drawCount});
+}
+
+// Where a mesh lives in the shared geometry buffers
+struct MeshRange
+{
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+
+    // firstIndex counts indices of indexType from the start of the shared
+    // index buffer, it is the index at byte indexOffset
+    vk::IndexType indexType;
+    vk::DeviceSize indexOffset;
+
+    // Multiply into the model matrix to undo vertex quantization
+    glm::mat4 dequantize;
+
+    // Levels of detail are consecutive entries sharing the vertex range.
+    // lodCount counts this level and the coarser ones following it, error is
+    // this level's distance from the full detail surface in mesh units
+    uint32_t lodCount;
+    float error;
+
+    // This level's range of the shared meshlet buffer
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+
+    // Bounding sphere of every level in mesh units, center and radius
+    glm::vec4 bounds;
+};
+
+// Per object input of the meshlet cull shader (std430). The shader writes
+// meshletCount draw commands starting at firstCommand
+struct MeshletCullTask
+{
+    glm::mat4 transform;
+    glm::vec4 sphere;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t firstCommand;
+    uint32_t instance;
+    int32_t vertexOffset;
+    uint32_t padding[3];
+};
+
+// Camera and depth pyramid the meshlet cull tests occlusion with (std140)
+struct OcclusionCullData
+{
+    glm::mat4 previousView;
+    glm::mat4 previousProj;
+    glm::vec2 pyramidSize;
+    uint32_t pyramidLevels;
+    uint32_t enabled;
+};
+
+// Counted by the meshlet cull shader
+struct CullStatistics
+{
+    uint32_t frustumCulledObjects;
+    uint32_t occludedObjects;
 };
 
 bool checkExtensionSupport(std::vector<const char *> requiredExtensions, std::vector<vk::ExtensionProperties> properties)
@@ -124,21 +401,27 @@ public:
     {
         initWindow();
         initVulkan();
+        if (enableStartupBenchmarks)
+        {
+            benchmarkTransforms();
+            benchmarkJobSystem();
+            benchmarkCommandPools();
+        }
         mainLoop();
         cleanup();
     }
 
 private:
-    const std::vector<Vertex> vertices{
-        {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-        {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-        {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-        {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}},
+    MeshData sceneMesh{
+        .vertices = {
+            {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+            {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+            {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}},
+        },
+        .indices = {0, 1, 2, 2, 3, 0},
     };
 
-    const std::vector<uint16_t> indices{
-        0, 1, 2, 2, 3, 0};
-
     GLFWwindow *window;
 
     vk::raii::Context context;
@@ -153,33 +436,163 @@ private:
     vk::raii::Queue presentQueue{nullptr};
 
     QueueFamilyIndices queueFamilyIndices;
+    uint32_t apiVersion;
+    OptionalDeviceFeatures optionalFeatures;
+    vk::Extent2D framebufferExtent;
     vk::Extent2D swapchainExtent;
     vk::Format swapchainFormat;
     // vk::SurfaceCapabilitiesKHR capabilities;
     vk::raii::SwapchainKHR swapchain{nullptr};
+    std::vector<vk::Image> swapchainImages;
     std::vector<vk::raii::ImageView> swapchainImageViews;
 
+    bool useDynamicRendering = false;
+
     vk::raii::RenderPass renderPass{nullptr};
     vk::raii::DescriptorSetLayout descriptorSetLayout{nullptr};
     vk::raii::PipelineLayout pipelineLayout{nullptr};
     vk::raii::Pipeline graphicsPipeline{nullptr};
+    vk::raii::Pipeline depthPrepassPipeline{nullptr};
+    bool useDepthPrepass = enableDepthPrepass;
 
     std::vector<vk::raii::Framebuffer> swapchainFrameBuffers;
 
+    // Only used by the render pass path, the render graph owns its own
+    vk::Format depthFormat;
+    vk::raii::Image depthImage{nullptr};
+    vk::raii::DeviceMemory depthImageMemory{nullptr};
+    vk::raii::ImageView depthImageView{nullptr};
+
+    // Replaces the render pass and framebuffers with dynamic rendering
+    std::unique_ptr<RenderGraph> renderGraph;
+    RenderGraph::Resource backbuffer;
+    RenderGraph::Resource depthBuffer;
+
+    // Used for one-off transfers
     vk::raii::CommandPool commandPool{nullptr};
-    std::vector<vk::raii::CommandBuffer> commandBuffers;
-    // std::array<vk::raii::CommandBuffer, MAX_FRAMES_IN_FLIGHT> commandBuffers;
+    std::vector<FrameCommandPool> frameCommandPools;
+
+    // One per (frame in flight, swapchain image) as descriptor sets are per frame
+    vk::raii::CommandPool staticCommandPool{nullptr};
+    std::vector<vk::raii::CommandBuffer> staticCommandBuffers;
+    std::vector<bool> staticCommandBuffersDirty;
+
+    // Shared by every mesh, see GEOMETRY_BUFFER_VERTICES
+    vk::raii::Buffer geometryVertexBuffer{nullptr};
+    vk::raii::DeviceMemory geometryVertexMemory{nullptr};
+    RangeAllocator geometryVertices;
+
+    // Handed out in 4 byte units, so every mesh starts aligned for any index
+    // type and is reached by binding the buffer at offset 0 with its type
+    vk::raii::Buffer geometryIndexBuffer{nullptr};
+    vk::raii::DeviceMemory geometryIndexMemory{nullptr};
+    RangeAllocator geometryIndices;
 
-    vk::raii::Buffer vertexBuffer{nullptr};
-    vk::raii::DeviceMemory vertexBufferMemory{nullptr};
+    // Bounds of every mesh's meshlets, firstIndex already points into the
+    // shared index buffer
+    vk::raii::Buffer geometryMeshletBuffer{nullptr};
+    vk::raii::DeviceMemory geometryMeshletMemory{nullptr};
+    RangeAllocator geometryMeshlets;
 
-    vk::raii::Buffer indexBuffer{nullptr};
-    vk::raii::DeviceMemory indexBufferMemory{nullptr};
+    std::vector<MeshRange> meshes;
+    uint32_t sceneMeshId = 0;
 
     std::vector<vk::raii::Buffer> uniformBuffers;
     std::vector<vk::raii::DeviceMemory> uniformBuffersMemory;
     std::vector<void *> uniformBuffersMapped;
 
+    // Per frame in flight, holds the objects in sorted draw order
+    std::vector<vk::raii::Buffer> instanceBuffers;
+    std::vector<vk::raii::DeviceMemory> instanceBuffersMemory;
+    std::vector<void *> instanceBuffersMapped;
+
+    // Per frame in flight, one indexed indirect command per draw batch
+    std::vector<vk::raii::Buffer> indirectBuffers;
+    std::vector<vk::raii::DeviceMemory> indirectBuffersMemory;
+    std::vector<void *> indirectBuffersMapped;
+
+    // Written by the main thread only, see captureFrameSnapshot. Renderables
+    // are entities with a scene node, mesh and material
+    EntityStore entities;
+    SceneGraph sceneGraph;
+    uint32_t sceneRoot = NO_PARENT;
+
+    // Only one pipeline so far
+    std::vector<Material> materials{{.pipeline = 0}};
+
+    // Per frame in flight, objects the instance, indirect and cull task
+    // buffers have room for and meshlet draws the meshlet draw buffer has.
+    // Each slot grows on its own once its last submission has finished, see
+    // reserveObjectBuffers
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> objectCapacities{};
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> meshletDrawCapacities{};
+
+    // Per frame in flight, see prepareDraws
+    std::array<std::vector<UploadedInstance>, MAX_FRAMES_IN_FLIGHT> uploadedInstances;
+    uint64_t instancesUploaded = 0;
+
+    std::vector<DrawItem> drawList;
+    std::vector<uint8_t> objectVisible;
+    std::vector<DrawBatch> drawBatches;
+
+    // See enableMeshletCulling. Per frame in flight, tasks are written by the
+    // CPU and draw commands by the cull shader
+    bool useMeshletCulling = false;
+    vk::raii::DescriptorSetLayout meshletCullDescriptorSetLayout{nullptr};
+    vk::raii::PipelineLayout meshletCullPipelineLayout{nullptr};
+    vk::raii::Pipeline meshletCullPipeline{nullptr};
+    std::vector<vk::raii::DescriptorSet> meshletCullDescriptorSets;
+    std::vector<vk::raii::Buffer> meshletCullTaskBuffers;
+    std::vector<vk::raii::DeviceMemory> meshletCullTaskBuffersMemory;
+    std::vector<void *> meshletCullTaskBuffersMapped;
+    std::vector<vk::raii::Buffer> meshletDrawBuffers;
+    std::vector<vk::raii::DeviceMemory> meshletDrawBuffersMemory;
+    uint32_t meshletCullTaskCount = 0;
+    uint32_t meshletDrawCount = 0;
+    std::vector<IndexTypeRun> meshletDrawRuns;
+    RenderGraph::Resource meshletDraws = 0;
+
+    // Culled object counts per frame in flight, summed until the next report
+    std::vector<vk::raii::Buffer> cullStatisticsBuffers;
+    std::vector<vk::raii::DeviceMemory> cullStatisticsBuffersMemory;
+    std::vector<void *> cullStatisticsBuffersMapped;
+    uint64_t frustumCulledObjects = 0;
+    uint64_t occludedObjects = 0;
+    uint64_t cullStatisticsFrames = 0;
+
+    // See enableOcclusionCulling. A single pyramid, built at the end of every
+    // frame and tested against by the next, recreated with the render graph
+    bool useOcclusionCulling = false;
+    vk::raii::DescriptorSetLayout depthPyramidDescriptorSetLayout{nullptr};
+    vk::raii::PipelineLayout depthPyramidPipelineLayout{nullptr};
+    vk::raii::Pipeline depthPyramidPipeline{nullptr};
+    vk::raii::DescriptorSetLayout occlusionDescriptorSetLayout{nullptr};
+    vk::raii::Sampler depthPyramidSampler{nullptr};
+    vk::raii::Image depthPyramidImage{nullptr};
+    vk::raii::DeviceMemory depthPyramidMemory{nullptr};
+    vk::raii::ImageView depthPyramidView{nullptr};
+    std::vector<vk::raii::ImageView> depthPyramidLevelViews;
+    vk::Extent2D depthPyramidExtent;
+    uint32_t depthPyramidLevels = 0;
+    RenderGraph::Resource depthPyramid = 0;
+
+    // One set per level reduced, then the one the meshlet cull samples the
+    // whole pyramid through
+    vk::raii::DescriptorPool depthPyramidDescriptorPool{nullptr};
+    std::vector<vk::raii::DescriptorSet> depthPyramidDescriptorSets;
+
+    // Whether the pyramid holds a frame yet, and the camera it was drawn with
+    bool depthPyramidValid = false;
+    UniformBufferObject previousCamera{};
+    std::vector<vk::raii::Buffer> occlusionCullBuffers;
+    std::vector<vk::raii::DeviceMemory> occlusionCullBuffersMemory;
+    std::vector<void *> occlusionCullBuffersMapped;
+
+    // One fragment invocation count per frame in flight
+    vk::raii::QueryPool statisticsQueryPool{nullptr};
+    uint64_t fragmentInvocations = 0;
+    uint64_t statisticsFrames = 0;
+
     vk::raii::DescriptorPool descriptorPool{nullptr};
     std::vector<vk::raii::DescriptorSet> descriptorSets;
 
@@ -189,12 +602,102 @@ private:
 
     uint32_t currentFrame = 0;
 
+    // Submitted frames are numbered from 1, frameSlotNumbers holds the last
+    // one submitted from each frame in flight
+    uint64_t frameNumber = 0;
+    uint64_t completedFrameNumber = 0;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameSlotNumbers{};
+
+    DeletionQueue deletionQueue;
+    std::atomic<bool> framebufferResized = false;
+    std::atomic<bool> depthPrepassRequested = enableDepthPrepass;
+
+    // Set by input callbacks on the main thread when on demand rendering
+    bool redrawRequested = true;
+
+    FramePacer framePacer{TARGET_FRAME_RATE};
+    DurationHistogram inputLatency;
+    DurationSummary transformTimes;
+    DurationSummary cullTimes;
+    std::chrono::steady_clock::time_point lastFrameStatsReport = std::chrono::steady_clock::now();
+
+    // Last frame presented with a present id, waited on before the next one
+    struct
+    {
+        uint64_t presentId = 0;
+        std::chrono::steady_clock::time_point inputTime;
+    } pendingPresent;
+
+    JobSystem jobSystem;
+
+    TripleBuffer<FrameSnapshot> frameSnapshots;
+    std::thread renderThread;
+    std::exception_ptr renderThreadError;
+
     void initWindow()
     {
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        framebufferExtent = vk::Extent2D{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, [](GLFWwindow *window, int, int, int)
+                                   { requestRedraw(window); });
+        glfwSetCursorPosCallback(window, [](GLFWwindow *window, double, double)
+                                 { requestRedraw(window); });
+        glfwSetScrollCallback(window, [](GLFWwindow *window, double, double)
+                              { requestRedraw(window); });
+    }
+
+    static void requestRedraw(GLFWwindow *window)
+    {
+        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
+        app->redrawRequested = true;
+    }
+
+    static void keyCallback(GLFWwindow *window, int key, int, int action, int)
+    {
+        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        {
+            app->depthPrepassRequested = !app->depthPrepassRequested;
+        }
+        requestRedraw(window);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
+    {
+        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
+        app->framebufferResized = true;
+        app->redrawRequested = true;
+    }
+
+    // Some platforms block the event loop while the window is being resized
+    // and only call back here, keep producing frames so the contents follow
+    static void windowRefreshCallback(GLFWwindow *window)
+    {
+        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
+
+        if (enableRenderThread)
+        {
+            app->captureFrameSnapshot(app->frameSnapshots.back());
+            app->frameSnapshots.publish();
+        }
+        else
+        {
+            FrameSnapshot snapshot;
+            app->captureFrameSnapshot(snapshot);
+            app->drawFrame(snapshot);
+        }
     }
 
     void initVulkan()
@@ -210,30 +713,60 @@ private:
         presentQueue = logicalDevice.getQueue(queueFamilyIndices.presentFamily, 0);
 
         createSwapchain();
-        createRenderPass();
+        depthFormat = findDepthFormat();
+
+        // The pyramid is reduced from the render graph's depth image, sampled
+        // as depth only
+        useOcclusionCulling = enableOcclusionCulling && useMeshletCulling && useDynamicRendering &&
+                              depthAspectMask() == vk::ImageAspectFlagBits::eDepth &&
+                              (physicalDevice.getFormatProperties(depthFormat).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+
+        if (!useDynamicRendering)
+        {
+            createRenderPass();
+        }
 
         createDescriptorSetLayout();
         createGraphicsPipeline();
+        createMeshletCullPipeline();
+        createDepthPyramidPipeline();
 
-        createFrameBuffers();
-
+        // Before the render graph, which records the depth pyramid's first
+        // layout transition
         commandPool = logicalDevice.createCommandPool({
-            .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+            .flags = vk::CommandPoolCreateFlagBits::eTransient,
             .queueFamilyIndex = queueFamilyIndices.graphicsFamily,
         });
 
-        createVertexBuffer();
-        createIndexBuffer();
+        createDepthResources();
+        createFrameBuffers();
+        createRenderGraph();
+
+        loadSceneMesh();
+        createGeometryBuffers();
+        sceneMeshId = uploadMesh(sceneMesh);
+        createScene();
         createUniformBuffers();
+        createObjectBuffers();
+        createMeshletCullBuffers();
+        createStatisticsQueryPool();
 
         createDescriptorPool();
         createDescriptorSets();
 
-        commandBuffers = std::move(logicalDevice.allocateCommandBuffers({
-            .commandPool = *commandPool,
-            .level = vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
-        }));
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            frameCommandPools.emplace_back(logicalDevice, queueFamilyIndices.graphicsFamily);
+        }
+
+        if (enableStaticScene)
+        {
+            staticCommandPool = logicalDevice.createCommandPool({
+                .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                .queueFamilyIndex = queueFamilyIndices.graphicsFamily,
+            });
+            createStaticCommandBuffers();
+        }
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
         {
@@ -246,12 +779,452 @@ private:
 
     void mainLoop()
     {
-        while (!glfwWindowShouldClose(window))
+        if (enableRenderThread)
         {
-            glfwPollEvents();
-            drawFrame();
+            renderThread = std::thread([this]
+                                       { renderLoop(); });
+
+            while (!glfwWindowShouldClose(window))
+            {
+                // Without a publish the render thread sleeps as well
+                if (waitForFrameRequest())
+                {
+                    captureFrameSnapshot(frameSnapshots.back());
+                    frameSnapshots.publish();
+                }
+            }
+
+            frameSnapshots.close();
+            renderThread.join();
+        }
+        else
+        {
+            FrameSnapshot snapshot;
+            while (!glfwWindowShouldClose(window))
+            {
+                paceFrame();
+                if (waitForFrameRequest())
+                {
+                    captureFrameSnapshot(snapshot);
+                    drawFrame(snapshot);
+                }
+            }
         }
         logicalDevice.waitIdle();
+
+        if (renderThreadError)
+        {
+            std::rethrow_exception(renderThreadError);
+        }
+    }
+
+    // Handles pending events, blocking while there is nothing to render.
+    // Returns whether a new frame should be produced
+    bool waitForFrameRequest()
+    {
+        if (isMinimized())
+        {
+            glfwWaitEvents();
+            return false;
+        }
+
+        if (enableOnDemandRendering && !animateScene && !redrawRequested)
+        {
+            glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+        }
+        else if (enableRenderThread)
+        {
+            glfwWaitEventsTimeout(1.0 / SIMULATION_RATE);
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+
+        if (isMinimized())
+        {
+            return false;
+        }
+
+        bool requested = !enableOnDemandRendering || animateScene || redrawRequested;
+        redrawRequested = false;
+        return requested;
+    }
+
+    bool isMinimized()
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        return width == 0 || height == 0 || glfwGetWindowAttrib(window, GLFW_ICONIFIED);
+    }
+
+    void renderLoop()
+    {
+        try
+        {
+            while (true)
+            {
+                paceFrame();
+                if (!frameSnapshots.acquire())
+                {
+                    break;
+                }
+                drawFrame(frameSnapshots.front());
+            }
+        }
+        catch (...)
+        {
+            renderThreadError = std::current_exception();
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+            glfwPostEmptyEvent();
+        }
+    }
+
+    // Runs on the presenting thread right before the newest input is sampled
+    void paceFrame()
+    {
+        if (pendingPresent.presentId != 0)
+        {
+            // Also keeps the queue of frames waiting for presentation short
+            auto result = vk::Result(logicalDevice.getDispatcher()->vkWaitForPresentKHR(
+                *logicalDevice, *swapchain, pendingPresent.presentId, PRESENT_WAIT_TIMEOUT));
+
+            if (result == vk::Result::eSuccess)
+            {
+                inputLatency.record(std::chrono::steady_clock::now() - pendingPresent.inputTime);
+            }
+            pendingPresent.presentId = 0;
+        }
+
+        framePacer.beginFrame();
+    }
+
+    void reportFrameStats()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!enableFrameStats || now - lastFrameStatsReport < std::chrono::duration<double>(FRAME_STATS_INTERVAL))
+        {
+            return;
+        }
+        lastFrameStatsReport = now;
+
+        framePacer.frameTimes.print(std::cout, "Frame time");
+        inputLatency.print(std::cout, optionalFeatures.presentWait ? "Input to present" : "Input to present (CPU)");
+        transformTimes.print(std::cout, (std::string("Transforms (") + TRANSFORM_SIMD_NAME + ")").c_str());
+        if (transformTimes.samples() > 0)
+        {
+            std::cout << "Instances uploaded: " << static_cast<double>(instancesUploaded) / transformTimes.samples() << " per frame\n";
+        }
+        if (enableFrustumCulling)
+        {
+            cullTimes.print(std::cout, (std::string("Frustum culling (") + TRANSFORM_SIMD_NAME + ")").c_str());
+        }
+
+        if (statisticsFrames > 0)
+        {
+            double perFrame = static_cast<double>(fragmentInvocations) / statisticsFrames;
+            std::cout << "Fragment invocations" << (useDepthPrepass ? " (depth pre-pass)" : "") << ": " << perFrame << " per frame, "
+                      << perFrame / (swapchainExtent.width * swapchainExtent.height) << " per pixel\n";
+        }
+
+        if (cullStatisticsFrames > 0)
+        {
+            std::cout << "Objects culled: " << static_cast<double>(frustumCulledObjects) / cullStatisticsFrames << " outside the frustum, "
+                      << static_cast<double>(occludedObjects) / cullStatisticsFrames << " occluded per frame\n";
+        }
+
+        framePacer.frameTimes.reset();
+        inputLatency.reset();
+        transformTimes.reset();
+        cullTimes.reset();
+        instancesUploaded = 0;
+        fragmentInvocations = 0;
+        statisticsFrames = 0;
+        frustumCulledObjects = 0;
+        occludedObjects = 0;
+        cullStatisticsFrames = 0;
+    }
+
+    // Runs on the main thread, the only one allowed to query GLFW
+    void captureFrameSnapshot(FrameSnapshot &snapshot)
+    {
+        static auto startTime = std::chrono::steady_clock::now();
+
+        snapshot.inputTime = std::chrono::steady_clock::now();
+
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        snapshot.framebufferExtent = vk::Extent2D{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(snapshot.inputTime - startTime).count();
+        float aspect = width / static_cast<float>(std::max(height, 1));
+
+        snapshot.ubo = UniformBufferObject{
+            .view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+            .proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f)};
+
+        snapshot.ubo.proj[1][1] *= -1;
+
+        if (animateScene)
+        {
+            sceneGraph.setTransform(sceneRoot, glm::vec3(0.0f), glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)), 1.0f);
+        }
+
+        auto transformStart = std::chrono::steady_clock::now();
+        sceneGraph.update(jobSystem, TRANSFORM_BATCH_SIZE);
+
+        auto count = entities.count<SceneNodeComponent, MeshComponent, MaterialComponent>();
+        snapshot.objectEntities.resize(count);
+        snapshot.objectMeshes.resize(count);
+        snapshot.objectMaterials.resize(count);
+        snapshot.objectTransforms.resize(count);
+        snapshot.objectBounds.resize(count);
+        snapshot.objectVersions.resize(count, 0);
+
+        uint32_t object = 0;
+        entities.forEach<SceneNodeComponent, MeshComponent, MaterialComponent>(
+            [&](size_t rows, const Entity *rowEntities, SceneNodeComponent *nodes, MeshComponent *meshComponents, MaterialComponent *materialComponents)
+            {
+                for (size_t row = 0; row < rows; ++row, ++object)
+                {
+                    snapshot.objectMeshes[object] = meshComponents[row].mesh;
+                    snapshot.objectMaterials[object] = materialComponents[row].material;
+
+                    uint32_t node = nodes[row].node;
+                    if (snapshot.objectEntities[object] == rowEntities[row] && snapshot.objectVersions[object] == sceneGraph.nodeVersion(node))
+                    {
+                        continue;
+                    }
+                    snapshot.objectEntities[object] = rowEntities[row];
+                    snapshot.objectTransforms[object] = sceneGraph.worldMatrix(node);
+                    snapshot.objectBounds.center.set(object, sceneGraph.worldBoxCenter(node));
+                    snapshot.objectBounds.extent.set(object, sceneGraph.worldBoxExtent(node));
+                    snapshot.objectVersions[object] = sceneGraph.nodeVersion(node);
+                }
+            });
+        snapshot.transformTime = std::chrono::steady_clock::now() - transformStart;
+    }
+
+    // A stack of overlapping quads fanned out around a root that spins, listed
+    // back to front so unsorted drawing is the worst case for overdraw. Each
+    // object is boxed by its mesh's bounding sphere
+    void createScene()
+    {
+        sceneRoot = sceneGraph.addNode(NO_PARENT, glm::vec3(0.0f), glm::vec3(0.0f));
+        for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i)
+        {
+            float height = static_cast<float>(i) / SCENE_OBJECT_COUNT - 0.5f;
+            float angle = i * glm::radians(360.0f / SCENE_OBJECT_COUNT);
+            createRenderable(sceneMeshId, 0, sceneRoot, glm::vec3(0.0f, 0.0f, height), glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+        }
+    }
+
+    Entity createRenderable(uint32_t mesh, uint32_t material, uint32_t parent, glm::vec3 translation, glm::quat rotation)
+    {
+        auto sphere = meshes[mesh].bounds;
+        uint32_t node = sceneGraph.addNode(parent, glm::vec3(sphere), glm::vec3(sphere.w));
+        sceneGraph.setTransform(node, translation, rotation, 1.0f);
+        return entities.create(SceneNodeComponent{node}, MeshComponent{mesh}, MaterialComponent{material});
+    }
+
+    // Times the scalar and SIMD kernels single threaded and the SIMD ones on
+    // the job system, best of a few runs over the same random objects
+    void benchmarkTransforms()
+    {
+        constexpr int RUNS = 5;
+        const uint32_t count = TRANSFORM_BENCHMARK_OBJECTS;
+
+        TransformStore store;
+        store.resize(count);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            glm::quat rotation(unit(random), unit(random), unit(random), unit(random));
+            store.set(i, glm::vec3(unit(random), unit(random), unit(random)) * 50.0f, glm::normalize(rotation), 1.0f + unit(random) * 0.5f);
+            store.localBounds.center.set(i, glm::vec3(unit(random), unit(random), unit(random)) * 0.1f);
+            store.localBounds.extent.set(i, glm::vec3(0.5f));
+        }
+
+        std::vector<glm::mat4> matrices(count);
+        BoxBounds worldBounds;
+        worldBounds.resize(count);
+        std::vector<uint8_t> visible(count);
+        auto proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        auto frustum = Frustum::fromMatrix(proj * glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+
+        auto time = [&](const char *name, auto &&kernel)
+        {
+            DurationHistogram::Duration best = DurationHistogram::Duration::max();
+            for (int run = 0; run < RUNS; ++run)
+            {
+                auto start = std::chrono::steady_clock::now();
+                kernel();
+                best = std::min<DurationHistogram::Duration>(best, std::chrono::steady_clock::now() - start);
+            }
+            std::cout << name << ": " << best.count() << "ms for " << count << " objects\n";
+        };
+
+        // Restored on return, later output keeps the stream's formatting
+        auto flags = std::cout.flags();
+        auto precision = std::cout.precision(3);
+        std::cout << std::fixed;
+        std::cout << "Transform kernels (" << TRANSFORM_SIMD_NAME << ", " << std::thread::hardware_concurrency() << " threads)\n";
+        time("  compose scalar", [&]
+             { composeTransformsScalar(store, 0, count, matrices.data(), worldBounds); });
+        time("  compose SIMD", [&]
+             { composeTransforms(store, 0, count, matrices.data(), worldBounds); });
+        time("  compose SIMD, job system", [&]
+             { jobSystem.parallelFor(count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+                                     { composeTransforms(store, begin, end, matrices.data(), worldBounds); }); });
+        time("  cull scalar", [&]
+             { cullBoxesScalar(worldBounds, frustum, 0, count, visible.data()); });
+        time("  cull SIMD", [&]
+             { cullBoxes(worldBounds, frustum, 0, count, visible.data()); });
+        time("  cull SIMD, job system", [&]
+             { jobSystem.parallelFor(count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+                                     { cullBoxes(worldBounds, frustum, begin, end, visible.data()); }); });
+
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+    // Times scheduling JOB_BENCHMARK_JOBS tiny jobs on the job system and on a
+    // mutex queue pool with as many workers, once all from the main thread
+    // and once spawned by jobs already running. Best of a few runs
+    void benchmarkJobSystem()
+    {
+        constexpr int RUNS = 5;
+        constexpr uint32_t SPAWNERS = 64;
+        const uint32_t count = JOB_BENCHMARK_JOBS;
+        MutexQueuePool mutexPool(jobSystem.workerCount());
+        std::atomic<uint32_t> done{0};
+
+        auto time = [&](const char *name, auto &&schedule)
+        {
+            DurationHistogram::Duration best = DurationHistogram::Duration::max();
+            for (int run = 0; run < RUNS; ++run)
+            {
+                done = 0;
+                auto start = std::chrono::steady_clock::now();
+                schedule();
+                best = std::min<DurationHistogram::Duration>(best, std::chrono::steady_clock::now() - start);
+                if (done != count)
+                {
+                    throw std::runtime_error("Job benchmark lost jobs!");
+                }
+            }
+            std::cout << name << ": " << best.count() << "ms for " << count << " jobs\n";
+        };
+        auto job = [&]
+        {
+            done.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        std::cout << "Job scheduling (" << jobSystem.workerCount() << " workers)\n";
+        time("  work stealing, from main thread", [&]
+             {
+                 JobCounter counter;
+                 for (uint32_t i = 0; i < count; ++i)
+                 {
+                     jobSystem.schedule(job, &counter);
+                 }
+                 jobSystem.wait(counter); });
+        time("  mutex queue, from main thread", [&]
+             {
+                 for (uint32_t i = 0; i < count; ++i)
+                 {
+                     mutexPool.schedule(job);
+                 }
+                 mutexPool.waitIdle(); });
+        time("  work stealing, spawned by jobs", [&]
+             {
+                 JobCounter counter;
+                 for (uint32_t spawner = 0; spawner < SPAWNERS; ++spawner)
+                 {
+                     jobSystem.schedule([&, spawner]
+                                        {
+                                            for (uint32_t i = spawner; i < count; i += SPAWNERS)
+                                            {
+                                                jobSystem.schedule(job, &counter);
+                                            } },
+                                        &counter);
+                 }
+                 jobSystem.wait(counter); });
+        time("  mutex queue, spawned by jobs", [&]
+             {
+                 for (uint32_t spawner = 0; spawner < SPAWNERS; ++spawner)
+                 {
+                     mutexPool.schedule([&, spawner]
+                                        {
+                                            for (uint32_t i = spawner; i < count; i += SPAWNERS)
+                                            {
+                                                mutexPool.schedule(job);
+                                            } });
+                 }
+                 mutexPool.waitIdle(); });
+    }
+
+    // Times resetting and recording COMMAND_BENCHMARK_BUFFERS small command
+    // buffers per frame, once with each buffer reset on its own like a pool
+    // created with eResetCommandBuffer and once with a FrameCommandPool reset
+    // as a whole. Nothing is submitted, so this is the CPU side only
+    void benchmarkCommandPools()
+    {
+        constexpr uint32_t FRAMES = 500;
+        constexpr uint32_t COMMANDS = 16;
+        const uint32_t count = COMMAND_BENCHMARK_BUFFERS;
+
+        auto record = [&](const vk::raii::CommandBuffer &commandBuffer)
+        {
+            commandBuffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+            for (uint32_t i = 0; i < COMMANDS; ++i)
+            {
+                commandBuffer.setViewport(0, vk::Viewport{.width = static_cast<float>(WIDTH), .height = static_cast<float>(HEIGHT), .maxDepth = 1.0f});
+                commandBuffer.setScissor(0, vk::Rect2D{.extent = {WIDTH, HEIGHT}});
+            }
+            commandBuffer.end();
+        };
+
+        auto time = [&](const char *name, auto &&frame)
+        {
+            // One untimed frame to allocate everything up front
+            frame();
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < FRAMES; ++i)
+            {
+                frame();
+            }
+            DurationHistogram::Duration elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << name << ": " << elapsed.count() / FRAMES << "ms per frame of " << count << " buffers\n";
+        };
+
+        vk::raii::CommandPool resettablePool = logicalDevice.createCommandPool({
+            .flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+            .queueFamilyIndex = queueFamilyIndices.graphicsFamily,
+        });
+        auto resettableBuffers = logicalDevice.allocateCommandBuffers({
+            .commandPool = *resettablePool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = count,
+        });
+        FrameCommandPool framePool(logicalDevice, queueFamilyIndices.graphicsFamily);
+
+        std::cout << "Command buffer recording\n";
+        time("  reset per buffer", [&]
+             {
+                 for (auto &commandBuffer : resettableBuffers)
+                 {
+                     commandBuffer.reset();
+                     record(commandBuffer);
+                 } });
+        time("  reset per pool", [&]
+             {
+                 framePool.reset();
+                 for (uint32_t i = 0; i < count; ++i)
+                 {
+                     record(framePool.acquire());
+                 } });
     }
 
     void cleanup()
@@ -283,10 +1256,12 @@ private:
             throw std::runtime_error("validation layers requested, but not available!");
         }
 
+        apiVersion = std::min(context.enumerateInstanceVersion(), VK_API_VERSION_1_3);
+
         vk::ApplicationInfo appInfo{
             .pApplicationName = APP_NAME,
             .pEngineName = APP_NAME,
-            .apiVersion = VK_API_VERSION_1_0,
+            .apiVersion = apiVersion,
         };
 
         uint32_t glfwExtensionCount = 0;
@@ -371,23 +1346,130 @@ private:
             });
         }
 
-        vk::PhysicalDeviceFeatures deviceFeatures{};
+        auto extensions = physicalDevice.enumerateDeviceExtensionProperties();
+        apiVersion = std::min(apiVersion, physicalDevice.getProperties().apiVersion);
+        queryOptionalFeatures(extensions);
 
-        vk::DeviceCreateInfo deviceCreateInfo{
-            .queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size()),
-            .pQueueCreateInfos = deviceQueueCreateInfos.data(),
-            .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
-            .ppEnabledExtensionNames = deviceExtensions.data(),
-            .pEnabledFeatures = &deviceFeatures,
+        vk::PhysicalDeviceFeatures deviceFeatures{
+            .multiDrawIndirect = optionalFeatures.multiDrawIndirect,
+            .drawIndirectFirstInstance = optionalFeatures.multiDrawIndirect,
+            .pipelineStatisticsQuery = optionalFeatures.pipelineStatistics,
         };
+        useDynamicRendering = preferDynamicRendering && optionalFeatures.dynamicRendering && optionalFeatures.synchronization2;
 
-        if (enableValidationLayers)
+        // The cull dispatch is recorded with the draws, so the graphics queue
+        // has to do compute as well
+        auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+        useMeshletCulling = enableMeshletCulling && optionalFeatures.multiDrawIndirect &&
+                            (queueFamilies[queueFamilyIndices.graphicsFamily].queueFlags & vk::QueueFlagBits::eCompute);
+
+        std::vector<const char *> enabledExtensions = deviceExtensions;
+
+        // Optional feature structs get linked in here as they are enabled
+        void *featureChain = nullptr;
+        auto enableFeatures = [&](auto &features)
         {
-            deviceCreateInfo.setPEnabledLayerNames(validationLayers);
+            features.pNext = featureChain;
+            featureChain = &features;
+        };
+
+        vk::PhysicalDevicePresentIdFeaturesKHR presentIdFeatures{.presentId = VK_TRUE};
+        vk::PhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{.presentWait = VK_TRUE};
+        if (optionalFeatures.presentWait)
+        {
+            enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            enableFeatures(presentIdFeatures);
+            enableFeatures(presentWaitFeatures);
+        }
+
+        vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{.dynamicRendering = VK_TRUE};
+        vk::PhysicalDeviceSynchronization2Features synchronization2Features{.synchronization2 = VK_TRUE};
+        if (useDynamicRendering)
+        {
+            if (apiVersion < VK_API_VERSION_1_3)
+            {
+                enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+                enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            }
+            enableFeatures(dynamicRenderingFeatures);
+            enableFeatures(synchronization2Features);
+        }
+
+        vk::PhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features{.indexTypeUint8 = VK_TRUE};
+        if (optionalFeatures.indexTypeUint8)
+        {
+            enabledExtensions.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+            enableFeatures(indexTypeUint8Features);
+        }
+
+        vk::DeviceCreateInfo deviceCreateInfo{
+            .pNext = featureChain,
+            .queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size()),
+            .pQueueCreateInfos = deviceQueueCreateInfos.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
+            .ppEnabledExtensionNames = enabledExtensions.data(),
+            .pEnabledFeatures = &deviceFeatures,
+        };
+
+        if (enableValidationLayers)
+        {
+            deviceCreateInfo.setPEnabledLayerNames(validationLayers);
         }
         logicalDevice = physicalDevice.createDevice(deviceCreateInfo);
     }
 
+    void queryOptionalFeatures(const std::vector<vk::ExtensionProperties> &extensions)
+    {
+        auto coreFeatures = physicalDevice.getFeatures();
+        optionalFeatures.pipelineStatistics = coreFeatures.pipelineStatisticsQuery;
+
+        // Batches start at arbitrary instances, which indirect draws only allow
+        // with drawIndirectFirstInstance
+        optionalFeatures.multiDrawIndirect = coreFeatures.multiDrawIndirect && coreFeatures.drawIndirectFirstInstance;
+
+        // Querying extension features needs vkGetPhysicalDeviceFeatures2
+        if (apiVersion < VK_API_VERSION_1_1)
+        {
+            return;
+        }
+
+        if (checkExtensionSupport({VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME}, extensions))
+        {
+            auto features = physicalDevice.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDevicePresentIdFeaturesKHR,
+                vk::PhysicalDevicePresentWaitFeaturesKHR>();
+
+            optionalFeatures.presentWait =
+                features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+                features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+        }
+
+        if (checkExtensionSupport({VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME}, extensions))
+        {
+            auto features = physicalDevice.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDeviceIndexTypeUint8FeaturesEXT>();
+
+            optionalFeatures.indexTypeUint8 = features.get<vk::PhysicalDeviceIndexTypeUint8FeaturesEXT>().indexTypeUint8;
+        }
+
+        // The extensions' dependencies are core in 1.2
+        if (apiVersion >= VK_API_VERSION_1_3 ||
+            (apiVersion >= VK_API_VERSION_1_2 &&
+             checkExtensionSupport({VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME}, extensions)))
+        {
+            auto features = physicalDevice.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDeviceDynamicRenderingFeatures,
+                vk::PhysicalDeviceSynchronization2Features>();
+
+            optionalFeatures.dynamicRendering = features.get<vk::PhysicalDeviceDynamicRenderingFeatures>().dynamicRendering;
+            optionalFeatures.synchronization2 = features.get<vk::PhysicalDeviceSynchronization2Features>().synchronization2;
+        }
+    }
+
     QueueFamilyIndices getQueueFamilyIndices(
         const std::vector<vk::QueueFamilyProperties> &properties)
     {
@@ -413,7 +1495,7 @@ private:
         throw std::runtime_error("Could not find a matching queue family index");
     }
 
-    void createSwapchain()
+    void createSwapchain(vk::SwapchainKHR oldSwapchain = nullptr)
     {
         auto capabilities = physicalDevice.getSurfaceCapabilitiesKHR(*surface);
         auto formats = physicalDevice.getSurfaceFormatsKHR(*surface);
@@ -434,12 +1516,10 @@ private:
         swapchainExtent = capabilities.currentExtent;
         if (swapchainExtent.width == std::numeric_limits<uint32_t>::max())
         {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
+            // Not queried from GLFW here as this may run on the render thread
             swapchainExtent = vk::Extent2D{
-                .width = std::clamp(static_cast<uint32_t>(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
-                .height = std::clamp(static_cast<uint32_t>(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height),
+                .width = std::clamp(framebufferExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+                .height = std::clamp(framebufferExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height),
             };
         }
 
@@ -461,7 +1541,7 @@ private:
             .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
             .presentMode = presentMode,
             .clipped = VK_TRUE,
-            .oldSwapchain = *swapchain};
+            .oldSwapchain = oldSwapchain};
 
         std::array indices = {queueFamilyIndices.graphicsFamily, queueFamilyIndices.presentFamily};
 
@@ -476,7 +1556,8 @@ private:
         }
         swapchain = logicalDevice.createSwapchainKHR(createInfo);
 
-        auto swapchainImages = swapchain.getImages();
+        auto images = swapchain.getImages();
+        swapchainImages.assign(images.begin(), images.end());
 
         swapchainImageViews.clear();
         swapchainImageViews.reserve(swapchainImages.size());
@@ -522,23 +1603,45 @@ private:
             .layout = vk::ImageLayout::eColorAttachmentOptimal,
         };
 
+        // Cleared every frame and never read back, so it is never stored
+        vk::AttachmentDescription depthAttachment{
+            .format = depthFormat,
+            .samples = vk::SampleCountFlagBits::e1,
+            .loadOp = vk::AttachmentLoadOp::eClear,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
+            .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+            .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+            .initialLayout = vk::ImageLayout::eUndefined,
+            .finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+        };
+
+        vk::AttachmentReference depthAttachmentRef{
+            .attachment = 1,
+            .layout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+        };
+
         vk::SubpassDescription subpass{
             .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
             .colorAttachmentCount = 1,
             .pColorAttachments = &colorAttachmentRef,
+            .pDepthStencilAttachment = &depthAttachmentRef,
         };
 
+        // The depth image is shared by all frames in flight, the clear has to
+        // wait for the previous frame's depth writes
         vk::SubpassDependency dependency{
             .srcSubpass = VK_SUBPASS_EXTERNAL,
             .dstSubpass = 0,
-            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-            // .srcAccessMask = 0,
-            .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-            .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite};
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests,
+            .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
+            .srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite};
+
+        std::array attachments{colorAttachment, depthAttachment};
 
         renderPass = logicalDevice.createRenderPass({
-            .attachmentCount = 1,
-            .pAttachments = &colorAttachment,
+            .attachmentCount = static_cast<uint32_t>(attachments.size()),
+            .pAttachments = attachments.data(),
             .subpassCount = 1,
             .pSubpasses = &subpass,
             .dependencyCount = 1,
@@ -548,8 +1651,16 @@ private:
 
     void createGraphicsPipeline()
     {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+        std::vector<char> vertShaderCode, fragShaderCode;
+
+        JobCounter shadersLoaded;
+        jobSystem.schedule([&]
+                           { vertShaderCode = readFile("shaders/vert.spv"); },
+                           &shadersLoaded);
+        jobSystem.schedule([&]
+                           { fragShaderCode = readFile("shaders/frag.spv"); },
+                           &shadersLoaded);
+        jobSystem.wait(shadersLoaded);
 
         auto vertShaderModule = logicalDevice.createShaderModule({
             .codeSize = vertShaderCode.size(),
@@ -583,15 +1694,8 @@ private:
             .pDynamicStates = dynamicStates.data(),
         };
 
-        auto bindingDescriptions = Vertex::getBindingDescriptions();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-        vk::PipelineVertexInputStateCreateInfo vertexInputStateInfo{
-            .vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size()),
-            .pVertexBindingDescriptions = bindingDescriptions.data(),
-            .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
-            .pVertexAttributeDescriptions = attributeDescriptions.data(),
-        };
+        // Bindings 0 and 1, locations as declared in shader.vert
+        auto vertexInputStateInfo = VertexInputLayout<SceneVertex, InstanceData>::createInfo();
 
         vk::PipelineInputAssemblyStateCreateInfo inputAssemblyStateInfo{
             .topology = vk::PrimitiveTopology::eTriangleList,
@@ -619,6 +1723,16 @@ private:
             .sampleShadingEnable = VK_FALSE,
         };
 
+        // After a depth pre-pass only the nearest fragment of each pixel
+        // passes, and the depth is already there
+        vk::PipelineDepthStencilStateCreateInfo depthStencilStateInfo{
+            .depthTestEnable = VK_TRUE,
+            .depthWriteEnable = useDepthPrepass ? VK_FALSE : VK_TRUE,
+            .depthCompareOp = useDepthPrepass ? vk::CompareOp::eEqual : vk::CompareOp::eLess,
+            .depthBoundsTestEnable = VK_FALSE,
+            .stencilTestEnable = VK_FALSE,
+        };
+
         vk::PipelineColorBlendAttachmentState colorBlendAttachmentState{
             .blendEnable = VK_FALSE,
             .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
@@ -635,9 +1749,19 @@ private:
             .pSetLayouts = &*descriptorSetLayout,
         };
 
+        retire(std::move(graphicsPipeline));
+        retire(std::move(depthPrepassPipeline));
+        retire(std::move(pipelineLayout));
         pipelineLayout = logicalDevice.createPipelineLayout(pipelineLayoutInfo);
 
+        vk::PipelineRenderingCreateInfo renderingInfo{
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &swapchainFormat,
+            .depthAttachmentFormat = depthFormat,
+        };
+
         vk::GraphicsPipelineCreateInfo pipelineInfo{
+            .pNext = useDynamicRendering ? &renderingInfo : nullptr,
             .stageCount = static_cast<uint32_t>(shaderStages.size()),
             .pStages = shaderStages.data(),
             .pVertexInputState = &vertexInputStateInfo,
@@ -645,260 +1769,1512 @@ private:
             .pViewportState = &viewportStateInfo,
             .pRasterizationState = &rasterizationStateInfo,
             .pMultisampleState = &multisampleStateInfo,
+            .pDepthStencilState = &depthStencilStateInfo,
             .pColorBlendState = &colorBlendingStateInfo,
             .pDynamicState = &dynamicStateInfo,
             .layout = *pipelineLayout,
-            .renderPass = *renderPass,
+            .renderPass = useDynamicRendering ? nullptr : *renderPass,
             .subpass = 0};
 
         graphicsPipeline = logicalDevice.createGraphicsPipeline(nullptr, pipelineInfo, nullptr);
-    }
-
-    void createFrameBuffers()
-    {
-        // TODO do i clear swapchainbuffers first
-        swapchainFrameBuffers.clear();
-        swapchainFrameBuffers.reserve(swapchainImageViews.size());
 
-        for (auto &&imageViews : swapchainImageViews)
+        if (useDepthPrepass)
         {
-            std::array attachments{*imageViews};
+            // Same vertex stage so the depth matches exactly, no fragment
+            // shader. Render pass draws keep the color attachment but mask it,
+            // the render graph runs the pre-pass without one
+            vk::PipelineDepthStencilStateCreateInfo prepassDepthStencilStateInfo{
+                .depthTestEnable = VK_TRUE,
+                .depthWriteEnable = VK_TRUE,
+                .depthCompareOp = vk::CompareOp::eLess,
+                .depthBoundsTestEnable = VK_FALSE,
+                .stencilTestEnable = VK_FALSE,
+            };
 
-            swapchainFrameBuffers.push_back(
-                logicalDevice.createFramebuffer({.renderPass = *renderPass,
-                                                 .attachmentCount = static_cast<uint32_t>(attachments.size()),
-                                                 .pAttachments = attachments.data(),
-                                                 .width = swapchainExtent.width,
-                                                 .height = swapchainExtent.height,
-                                                 .layers = 1}));
-        }
-    }
+            vk::PipelineColorBlendAttachmentState prepassColorBlendAttachmentState{
+                .blendEnable = VK_FALSE,
+                .colorWriteMask = {},
+            };
 
-    void recordCommandBuffer(const vk::raii::CommandBuffer &commandBuffer, uint32_t imageIndex)
-    {
-        commandBuffer.begin({});
+            vk::PipelineColorBlendStateCreateInfo prepassColorBlendingStateInfo{
+                .logicOpEnable = VK_FALSE,
+                .attachmentCount = useDynamicRendering ? 0u : 1u,
+                .pAttachments = &prepassColorBlendAttachmentState,
+            };
 
-        vk::ClearValue clearColor({{{0.0f, 0.0f, 0.0f, 1.0f}}});
+            vk::PipelineRenderingCreateInfo prepassRenderingInfo{
+                .colorAttachmentCount = 0,
+                .depthAttachmentFormat = depthFormat,
+            };
 
-        vk::RenderPassBeginInfo renderPassInfo{
-            .renderPass = *renderPass,
-            .framebuffer = *swapchainFrameBuffers[imageIndex],
-            .renderArea = {
-                .offset = {0, 0},
-                .extent = swapchainExtent,
-            },
-            .clearValueCount = 1,
-            .pClearValues = &clearColor};
+            pipelineInfo.pNext = useDynamicRendering ? &prepassRenderingInfo : nullptr;
+            pipelineInfo.stageCount = 1;
+            pipelineInfo.pDepthStencilState = &prepassDepthStencilStateInfo;
+            pipelineInfo.pColorBlendState = &prepassColorBlendingStateInfo;
 
-        commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+            depthPrepassPipeline = logicalDevice.createGraphicsPipeline(nullptr, pipelineInfo, nullptr);
+        }
 
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline);
+        markSceneDirty();
+    }
 
-        vk::Viewport viewport{
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(swapchainExtent.width),
-            .height = static_cast<float>(swapchainExtent.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f,
-        };
-        commandBuffer.setViewport(0, viewport);
+    void createMeshletCullPipeline()
+    {
+        if (!useMeshletCulling)
+        {
+            return;
+        }
 
-        vk::Rect2D scissor{
-            .offset = {0, 0},
-            .extent = swapchainExtent,
+        // Camera, meshlets, cull tasks, draw commands, statistics, occlusion data
+        std::array bindings{
+            vk::DescriptorSetLayoutBinding{
+                .binding = 0,
+                .descriptorType = vk::DescriptorType::eUniformBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 1,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 2,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 3,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 4,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 5,
+                .descriptorType = vk::DescriptorType::eUniformBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
         };
-        commandBuffer.setScissor(0, scissor);
 
-        commandBuffer.bindVertexBuffers(0, {*vertexBuffer}, {0});
-        commandBuffer.bindIndexBuffer(*indexBuffer, 0, vk::IndexType::eUint16);
+        meshletCullDescriptorSetLayout = logicalDevice.createDescriptorSetLayout({
+            .bindingCount = static_cast<uint32_t>(bindings.size()),
+            .pBindings = bindings.data(),
+        });
 
-        commandBuffer.bindDescriptorSets(
-            vk::PipelineBindPoint::eGraphics,
-            *pipelineLayout, 0, {*descriptorSets[currentFrame]}, nullptr);
+        std::vector<vk::DescriptorSetLayout> setLayouts{*meshletCullDescriptorSetLayout};
+        if (useOcclusionCulling)
+        {
+            // The depth pyramid, a set of its own as it is recreated on resize
+            vk::DescriptorSetLayoutBinding pyramidBinding{
+                .binding = 0,
+                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            };
+            occlusionDescriptorSetLayout = logicalDevice.createDescriptorSetLayout({
+                .bindingCount = 1,
+                .pBindings = &pyramidBinding,
+            });
+            setLayouts.push_back(*occlusionDescriptorSetLayout);
+        }
 
-        commandBuffer.drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+        meshletCullPipelineLayout = logicalDevice.createPipelineLayout({
+            .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+            .pSetLayouts = setLayouts.data(),
+        });
 
-        commandBuffer.endRenderPass();
+        // The same shader built with OCCLUSION_CULLING defined
+        auto shaderCode = readFile(useOcclusionCulling ? "shaders/meshlet_cull_occlusion.spv" : "shaders/meshlet_cull.spv");
+        auto shaderModule = logicalDevice.createShaderModule({
+            .codeSize = shaderCode.size(),
+            .pCode = reinterpret_cast<const uint32_t *>(shaderCode.data()),
+        });
 
-        commandBuffer.end();
+        meshletCullPipeline = logicalDevice.createComputePipeline(nullptr, {
+            .stage = {
+                .stage = vk::ShaderStageFlagBits::eCompute,
+                .module = *shaderModule,
+                .pName = "main",
+            },
+            .layout = *meshletCullPipelineLayout,
+        });
     }
 
-    void drawFrame()
+    void createDepthPyramidPipeline()
     {
-        if (logicalDevice.waitForFences(*inFlightFences[currentFrame], VK_TRUE, UINT64_MAX) != vk::Result::eSuccess)
-        {
-            std::cerr << "DrawFrame:\tCould not wait for fences\n";
-        }
-
-        auto [result, imageIndex] = swapchain.acquireNextImage(UINT64_MAX, *imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE);
-
-        if (result == vk::Result::eErrorOutOfDateKHR)
+        if (!useOcclusionCulling)
         {
-            recreateSwapchain();
             return;
         }
-        else if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR)
-        {
-            throw std::runtime_error("failed to acquire swap chain image!");
-        }
 
-        logicalDevice.resetFences(*inFlightFences[currentFrame]);
-
-        commandBuffers[currentFrame].reset();
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
-
-        std::array waitSemaphores{*imageAvailableSemaphores[currentFrame]};
-        std::array<vk::PipelineStageFlags, waitSemaphores.size()> waitStages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
-
-        std::array signalSemaphores{*renderFinishedSemaphores[currentFrame]};
-
-        updateUniformBuffer(currentFrame);
-
-        vk::SubmitInfo submitInfo{
-            .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
-            .pWaitSemaphores = waitSemaphores.data(),
-            .pWaitDstStageMask = waitStages.data(),
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*commandBuffers[currentFrame],
-            .signalSemaphoreCount = signalSemaphores.size(),
-            .pSignalSemaphores = signalSemaphores.data(),
+        // Level to reduce, level to write
+        std::array bindings{
+            vk::DescriptorSetLayoutBinding{
+                .binding = 0,
+                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
+            vk::DescriptorSetLayoutBinding{
+                .binding = 1,
+                .descriptorType = vk::DescriptorType::eStorageImage,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            },
         };
 
-        graphicsQueue.submit({submitInfo}, *inFlightFences[currentFrame]);
+        depthPyramidDescriptorSetLayout = logicalDevice.createDescriptorSetLayout({
+            .bindingCount = static_cast<uint32_t>(bindings.size()),
+            .pBindings = bindings.data(),
+        });
 
-        std::array swapchains = {*swapchain};
-        vk::PresentInfoKHR presentInfo{
-            .waitSemaphoreCount = signalSemaphores.size(),
-            .pWaitSemaphores = signalSemaphores.data(),
-            .swapchainCount = swapchains.size(),
-            .pSwapchains = swapchains.data(),
-            .pImageIndices = &imageIndex,
-        };
-        VkPresentInfoKHR info = presentInfo;
+        depthPyramidPipelineLayout = logicalDevice.createPipelineLayout({
+            .setLayoutCount = 1,
+            .pSetLayouts = &*depthPyramidDescriptorSetLayout,
+        });
 
-        result = vk::Result(vkQueuePresentKHR(*presentQueue, &info));
-        // result = presentQueue.presentKHR(presentInfo);
-        if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
-        {
-            recreateSwapchain();
-        }
-        else if (result != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("failed to present swap chain image!");
-        }
+        auto shaderCode = readFile("shaders/depth_pyramid.spv");
+        auto shaderModule = logicalDevice.createShaderModule({
+            .codeSize = shaderCode.size(),
+            .pCode = reinterpret_cast<const uint32_t *>(shaderCode.data()),
+        });
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        depthPyramidPipeline = logicalDevice.createComputePipeline(nullptr, {
+            .stage = {
+                .stage = vk::ShaderStageFlagBits::eCompute,
+                .module = *shaderModule,
+                .pName = "main",
+            },
+            .layout = *depthPyramidPipelineLayout,
+        });
+
+        // Both shaders read exact texels with texelFetch
+        depthPyramidSampler = logicalDevice.createSampler({
+            .magFilter = vk::Filter::eNearest,
+            .minFilter = vk::Filter::eNearest,
+            .mipmapMode = vk::SamplerMipmapMode::eNearest,
+            .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+            .maxLod = vk::LodClampNone,
+        });
     }
 
-    void recreateSwapchain()
+    // Called on the presenting thread, swaps the pipelines and passes
+    void setDepthPrepass(bool enabled)
     {
-        logicalDevice.waitIdle();
+        useDepthPrepass = enabled;
+        createGraphicsPipeline();
+        createRenderGraph();
 
-        createSwapchain();
-        createFrameBuffers();
+        fragmentInvocations = 0;
+        statisticsFrames = 0;
     }
 
-    uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+    vk::Format findDepthFormat()
     {
-        auto memoryProperties = physicalDevice.getMemoryProperties();
-
-        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+        for (auto format : {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint})
         {
-            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            auto properties = physicalDevice.getFormatProperties(format);
+            if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
             {
-                return i;
+                return format;
             }
         }
 
-        throw std::runtime_error("Failed to find a suitable memory type!");
+        throw std::runtime_error("Failed to find a supported depth format!");
     }
 
-    std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> createBuffer(
-        vk::DeviceSize size,
-        vk::BufferUsageFlags usage,
-        vk::MemoryPropertyFlags properties)
+    vk::ImageAspectFlags depthAspectMask() const
     {
-        auto buffer = logicalDevice.createBuffer({
-            .size = size,
-            .usage = usage,
-            .sharingMode = vk::SharingMode::eExclusive,
-        });
+        if (depthFormat == vk::Format::eD32SfloatS8Uint || depthFormat == vk::Format::eD24UnormS8Uint)
+        {
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        }
+        return vk::ImageAspectFlagBits::eDepth;
+    }
 
-        auto memoryRequirements = buffer.getMemoryRequirements();
+    void createDepthResources()
+    {
+        retire(std::move(depthImageView));
+        retire(std::move(depthImage));
+        retire(std::move(depthImageMemory));
+        if (useDynamicRendering)
+        {
+            return;
+        }
 
-        auto memory = logicalDevice.allocateMemory({
-            .allocationSize = size,
-            .memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties),
+        // Never leaves tile memory on tiled GPUs, where lazily allocated
+        // memory means it may not need any backing at all
+        depthImage = logicalDevice.createImage({
+            .imageType = vk::ImageType::e2D,
+            .format = depthFormat,
+            .extent = {swapchainExtent.width, swapchainExtent.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined,
         });
 
-        buffer.bindMemory(*memory, 0);
+        auto memoryRequirements = depthImage.getMemoryRequirements();
+        auto memoryType = tryFindMemoryType(
+            memoryRequirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated);
 
-        return std::make_pair(std::move(buffer), std::move(memory));
+        depthImageMemory = logicalDevice.allocateMemory({
+            .allocationSize = memoryRequirements.size,
+            .memoryTypeIndex = memoryType ? *memoryType : findMemoryType(memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal),
+        });
+        depthImage.bindMemory(*depthImageMemory, 0);
+
+        depthImageView = logicalDevice.createImageView({
+            .image = *depthImage,
+            .viewType = vk::ImageViewType::e2D,
+            .format = depthFormat,
+            .subresourceRange = {
+                .aspectMask = depthAspectMask(),
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        });
     }
 
-    void copyBuffer(const vk::raii::Buffer &srcBuffer, const vk::raii::Buffer &dstBuffer, vk::DeviceSize size)
+    void createFrameBuffers()
     {
-        vk::CommandBufferAllocateInfo allocateInfo{
-            .commandPool = *commandPool,
-            .level = vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = 1,
-        };
-
-        auto commandBuffers = logicalDevice.allocateCommandBuffers(allocateInfo);
-        auto &commandBuffer = commandBuffers.front();
+        // TODO do i clear swapchainbuffers first
+        swapchainFrameBuffers.clear();
+        if (useDynamicRendering)
+        {
+            return;
+        }
+        swapchainFrameBuffers.reserve(swapchainImageViews.size());
 
-        commandBuffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-        commandBuffer.copyBuffer(*srcBuffer, *dstBuffer, vk::BufferCopy{.size = size});
-        commandBuffer.end();
+        for (auto &&imageViews : swapchainImageViews)
+        {
+            std::array attachments{*imageViews, *depthImageView};
 
-        graphicsQueue.submit({vk::SubmitInfo{
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*commandBuffer,
-        }});
-        graphicsQueue.waitIdle();
+            swapchainFrameBuffers.push_back(
+                logicalDevice.createFramebuffer({.renderPass = *renderPass,
+                                                 .attachmentCount = static_cast<uint32_t>(attachments.size()),
+                                                 .pAttachments = attachments.data(),
+                                                 .width = swapchainExtent.width,
+                                                 .height = swapchainExtent.height,
+                                                 .layers = 1}));
+        }
+    }
+
+    void createRenderGraph()
+    {
+        if (renderGraph)
+        {
+            retire(std::move(renderGraph));
+        }
+        if (!useDynamicRendering)
+        {
+            return;
+        }
+
+        renderGraph = std::make_unique<RenderGraph>(logicalDevice, physicalDevice);
+
+        // Contents are discarded on acquire. Treating the acquire semaphore's
+        // wait stage as the last write chains the layout transition after it
+        backbuffer = renderGraph->importImage(
+            "backbuffer", swapchainFormat, swapchainExtent, vk::ImageAspectFlagBits::eColor,
+            vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits2::eColorAttachmentOutput);
+        depthBuffer = renderGraph->createImage("depth", depthFormat, swapchainExtent, depthAspectMask());
+
+        // Draw commands come from the cull shader, rebound per frame
+        auto readMeshletDraws = [&](RenderGraph::PassBuilder &pass)
+        {
+            if (useMeshletCulling)
+            {
+                pass.buffer(meshletDraws, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+            }
+        };
+        if (useOcclusionCulling)
+        {
+            // Largest power of two fitting the depth buffer, so every level
+            // halves the one before exactly
+            depthPyramidExtent = vk::Extent2D{std::bit_floor(swapchainExtent.width), std::bit_floor(swapchainExtent.height)};
+            depthPyramidLevels = std::bit_width(std::max(depthPyramidExtent.width, depthPyramidExtent.height));
+
+            // Left by the previous frame's reduction
+            depthPyramid = renderGraph->importImage(
+                "depth pyramid", vk::Format::eR32Sfloat, depthPyramidExtent, vk::ImageAspectFlagBits::eColor,
+                vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+                depthPyramidLevels);
+        }
+
+        if (useMeshletCulling)
+        {
+            meshletDraws = renderGraph->importBuffer("meshlet draws");
+            renderGraph->addPass(
+                "meshlet cull", vk::PipelineBindPoint::eCompute,
+                [&](RenderGraph::PassBuilder &pass)
+                {
+                    pass.buffer(meshletDraws, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite);
+                    if (useOcclusionCulling)
+                    {
+                        pass.sampledImage(depthPyramid, vk::PipelineStageFlagBits2::eComputeShader, vk::ImageLayout::eGeneral);
+                    }
+                },
+                [this](const vk::raii::CommandBuffer &commandBuffer)
+                { recordMeshletCull(commandBuffer); });
+        }
+
+        if (useDepthPrepass)
+        {
+            renderGraph->addPass(
+                "depth prepass", vk::PipelineBindPoint::eGraphics,
+                [&](RenderGraph::PassBuilder &pass)
+                {
+                    pass.depthAttachment(depthBuffer, vk::AttachmentLoadOp::eClear, 1.0f);
+                    readMeshletDraws(pass);
+                },
+                [this](const vk::raii::CommandBuffer &commandBuffer)
+                { recordDraws(commandBuffer, *depthPrepassPipeline, false); });
+        }
+
+        renderGraph->addPass(
+            "scene", vk::PipelineBindPoint::eGraphics,
+            [&](RenderGraph::PassBuilder &pass)
+            {
+                pass.colorAttachment(backbuffer, vk::AttachmentLoadOp::eClear, vk::ClearColorValue{std::array{0.0f, 0.0f, 0.0f, 1.0f}});
+                if (useDepthPrepass)
+                {
+                    pass.depthAttachment(depthBuffer, vk::AttachmentLoadOp::eLoad, 1.0f, false);
+                }
+                else
+                {
+                    pass.depthAttachment(depthBuffer, vk::AttachmentLoadOp::eClear, 1.0f);
+                }
+                readMeshletDraws(pass);
+            },
+            [this](const vk::raii::CommandBuffer &commandBuffer)
+            { recordDraws(commandBuffer, *graphicsPipeline, true); });
+
+        if (useOcclusionCulling)
+        {
+            // For the next frame's cull, which keeps the pass alive
+            renderGraph->addPass(
+                "depth pyramid", vk::PipelineBindPoint::eCompute,
+                [&](RenderGraph::PassBuilder &pass)
+                {
+                    pass.sampledImage(depthBuffer, vk::PipelineStageFlagBits2::eComputeShader);
+                    pass.storageImage(depthPyramid, vk::PipelineStageFlagBits2::eComputeShader, true);
+                },
+                [this](const vk::raii::CommandBuffer &commandBuffer)
+                { recordDepthPyramid(commandBuffer); });
+            renderGraph->markOutput(depthPyramid, vk::ImageLayout::eGeneral);
+        }
+
+        // Presentation is ordered by the render finished semaphore
+        renderGraph->markOutput(backbuffer, vk::ImageLayout::ePresentSrcKHR);
+        renderGraph->compile();
+
+        if (useOcclusionCulling)
+        {
+            createDepthPyramid();
+            renderGraph->bindImage(depthPyramid, *depthPyramidImage, *depthPyramidView);
+        }
+    }
+
+    // Needs the compiled render graph, whose depth image level 0 is reduced from
+    void createDepthPyramid()
+    {
+        retire(std::move(depthPyramidDescriptorSets));
+        retire(std::move(depthPyramidDescriptorPool));
+        retire(std::move(depthPyramidLevelViews));
+        retire(std::move(depthPyramidView));
+        retire(std::move(depthPyramidImage));
+        retire(std::move(depthPyramidMemory));
+        depthPyramidValid = false;
+
+        depthPyramidImage = logicalDevice.createImage({
+            .imageType = vk::ImageType::e2D,
+            .format = vk::Format::eR32Sfloat,
+            .extent = {depthPyramidExtent.width, depthPyramidExtent.height, 1},
+            .mipLevels = depthPyramidLevels,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined,
+        });
+
+        auto memoryRequirements = depthPyramidImage.getMemoryRequirements();
+        depthPyramidMemory = logicalDevice.allocateMemory({
+            .allocationSize = memoryRequirements.size,
+            .memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal),
+        });
+        depthPyramidImage.bindMemory(*depthPyramidMemory, 0);
+
+        // The render graph expects it in eGeneral, as the last reduction left it
+        vk::CommandBufferAllocateInfo allocateInfo{
+            .commandPool = *commandPool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1,
+        };
+
+        auto commandBuffers = logicalDevice.allocateCommandBuffers(allocateInfo);
+        auto &commandBuffer = commandBuffers.front();
+
+        commandBuffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        vk::ImageMemoryBarrier barrier{
+            .srcAccessMask = {},
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            .oldLayout = vk::ImageLayout::eUndefined,
+            .newLayout = vk::ImageLayout::eGeneral,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = *depthPyramidImage,
+            .subresourceRange = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel = 0,
+                .levelCount = depthPyramidLevels,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader,
+            {}, nullptr, nullptr, barrier);
+        commandBuffer.end();
+
+        graphicsQueue.submit({vk::SubmitInfo{
+            .commandBufferCount = 1,
+            .pCommandBuffers = &*commandBuffer,
+        }});
+
+        retire(std::move(commandBuffer));
+
+        auto createView = [&](uint32_t baseLevel, uint32_t levelCount)
+        {
+            return logicalDevice.createImageView({
+                .image = *depthPyramidImage,
+                .viewType = vk::ImageViewType::e2D,
+                .format = vk::Format::eR32Sfloat,
+                .subresourceRange = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .baseMipLevel = baseLevel,
+                    .levelCount = levelCount,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            });
+        };
+
+        depthPyramidView = createView(0, depthPyramidLevels);
+        depthPyramidLevelViews.clear();
+        for (uint32_t level = 0; level < depthPyramidLevels; ++level)
+        {
+            depthPyramidLevelViews.push_back(createView(level, 1));
+        }
+
+        std::array poolSizes{
+            vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount = depthPyramidLevels + 1,
+            },
+            vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eStorageImage,
+                .descriptorCount = depthPyramidLevels,
+            },
+        };
+
+        depthPyramidDescriptorPool = logicalDevice.createDescriptorPool({
+            .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+            .maxSets = depthPyramidLevels + 1,
+            .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+            .pPoolSizes = poolSizes.data(),
+        });
+
+        std::vector<vk::DescriptorSetLayout> layouts(depthPyramidLevels, *depthPyramidDescriptorSetLayout);
+        layouts.push_back(*occlusionDescriptorSetLayout);
+
+        depthPyramidDescriptorSets = logicalDevice.allocateDescriptorSets({
+            .descriptorPool = *depthPyramidDescriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+            .pSetLayouts = layouts.data(),
+        });
+
+        // Level 0 reads the depth buffer, every other level the one before
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        imageInfos.reserve(2 * depthPyramidLevels + 1);
+        std::vector<vk::WriteDescriptorSet> descriptorWrites;
+        for (uint32_t level = 0; level < depthPyramidLevels; ++level)
+        {
+            imageInfos.push_back({
+                .sampler = *depthPyramidSampler,
+                .imageView = level == 0 ? renderGraph->imageView(depthBuffer) : *depthPyramidLevelViews[level - 1],
+                .imageLayout = level == 0 ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eGeneral,
+            });
+            descriptorWrites.push_back({
+                .dstSet = *depthPyramidDescriptorSets[level],
+                .dstBinding = 0,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                .pImageInfo = &imageInfos.back(),
+            });
+
+            imageInfos.push_back({
+                .imageView = *depthPyramidLevelViews[level],
+                .imageLayout = vk::ImageLayout::eGeneral,
+            });
+            descriptorWrites.push_back({
+                .dstSet = *depthPyramidDescriptorSets[level],
+                .dstBinding = 1,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eStorageImage,
+                .pImageInfo = &imageInfos.back(),
+            });
+        }
+
+        imageInfos.push_back({
+            .sampler = *depthPyramidSampler,
+            .imageView = *depthPyramidView,
+            .imageLayout = vk::ImageLayout::eGeneral,
+        });
+        descriptorWrites.push_back({
+            .dstSet = *depthPyramidDescriptorSets.back(),
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &imageInfos.back(),
+        });
+
+        logicalDevice.updateDescriptorSets(descriptorWrites, nullptr);
+    }
+
+    void recordCommandBuffer(const vk::raii::CommandBuffer &commandBuffer, uint32_t imageIndex)
+    {
+        commandBuffer.begin({});
+
+        if (optionalFeatures.pipelineStatistics)
+        {
+            commandBuffer.resetQueryPool(*statisticsQueryPool, currentFrame, 1);
+        }
+
+        if (useDynamicRendering)
+        {
+            renderGraph->bindImage(backbuffer, swapchainImages[imageIndex], *swapchainImageViews[imageIndex]);
+            if (useMeshletCulling)
+            {
+                renderGraph->bindBuffer(meshletDraws, *meshletDrawBuffers[currentFrame]);
+            }
+            renderGraph->execute(commandBuffer);
+        }
+        else
+        {
+            if (useMeshletCulling)
+            {
+                recordMeshletCull(commandBuffer);
+
+                vk::MemoryBarrier barrier{
+                    .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+                    .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead,
+                };
+                commandBuffer.pipelineBarrier(
+                    vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect,
+                    {}, barrier, nullptr, nullptr);
+            }
+
+            std::array<vk::ClearValue, 2> clearValues;
+            clearValues[0].color = vk::ClearColorValue{std::array{0.0f, 0.0f, 0.0f, 1.0f}};
+            clearValues[1].depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
+
+            vk::RenderPassBeginInfo renderPassInfo{
+                .renderPass = *renderPass,
+                .framebuffer = *swapchainFrameBuffers[imageIndex],
+                .renderArea = {
+                    .offset = {0, 0},
+                    .extent = swapchainExtent,
+                },
+                .clearValueCount = static_cast<uint32_t>(clearValues.size()),
+                .pClearValues = clearValues.data()};
+
+            commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+            if (useDepthPrepass)
+            {
+                // Same subpass, depth writes are ordered by rasterization order
+                recordDraws(commandBuffer, *depthPrepassPipeline, false);
+            }
+            recordDraws(commandBuffer, *graphicsPipeline, true);
+            commandBuffer.endRenderPass();
+        }
+
+        if (useMeshletCulling)
+        {
+            // Cull statistics are read on the host once the fence signals
+            vk::MemoryBarrier barrier{
+                .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+                .dstAccessMask = vk::AccessFlagBits::eHostRead,
+            };
+            commandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+                {}, barrier, nullptr, nullptr);
+        }
+
+        commandBuffer.end();
+    }
+
+    void recordDraws(const vk::raii::CommandBuffer &commandBuffer, vk::Pipeline pipeline, bool countFragments)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+        vk::Viewport viewport{
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(swapchainExtent.width),
+            .height = static_cast<float>(swapchainExtent.height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        commandBuffer.setViewport(0, viewport);
+
+        vk::Rect2D scissor{
+            .offset = {0, 0},
+            .extent = swapchainExtent,
+        };
+        commandBuffer.setScissor(0, scissor);
+
+        commandBuffer.bindVertexBuffers(0, {*geometryVertexBuffer, *instanceBuffers[currentFrame]}, {0, 0});
+
+        commandBuffer.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,
+            *pipelineLayout, 0, {*descriptorSets[currentFrame]}, nullptr);
+
+        countFragments = countFragments && optionalFeatures.pipelineStatistics;
+        if (countFragments)
+        {
+            commandBuffer.beginQuery(*statisticsQueryPool, currentFrame, {});
+        }
+
+        // Only the contents of the instance and indirect buffers change from
+        // frame to frame
+        if (useMeshletCulling)
+        {
+            for (auto &run : meshletDrawRuns)
+            {
+                commandBuffer.bindIndexBuffer(*geometryIndexBuffer, 0, run.indexType);
+                commandBuffer.drawIndexedIndirect(
+                    *meshletDrawBuffers[currentFrame], run.firstDraw * sizeof(vk::DrawIndexedIndirectCommand),
+                    run.drawCount, sizeof(vk::DrawIndexedIndirectCommand));
+            }
+        }
+        else
+        {
+            std::vector<IndexTypeRun> runs;
+            for (auto &batch : drawBatches)
+            {
+                appendIndexTypeRun(runs, meshes[batch.mesh].indexType, 1);
+            }
+
+            for (auto &run : runs)
+            {
+                commandBuffer.bindIndexBuffer(*geometryIndexBuffer, 0, run.indexType);
+                if (optionalFeatures.multiDrawIndirect)
+                {
+                    commandBuffer.drawIndexedIndirect(
+                        *indirectBuffers[currentFrame], run.firstDraw * sizeof(vk::DrawIndexedIndirectCommand),
+                        run.drawCount, sizeof(vk::DrawIndexedIndirectCommand));
+                    continue;
+                }
+
+                for (uint32_t i = run.firstDraw; i < run.firstDraw + run.drawCount; ++i)
+                {
+                    auto &batch = drawBatches[i];
+                    auto &mesh = meshes[batch.mesh];
+                    commandBuffer.drawIndexed(mesh.indexCount, batch.instanceCount, mesh.firstIndex, mesh.vertexOffset, batch.firstInstance);
+                }
+            }
+        }
+
+        if (countFragments)
+        {
+            commandBuffer.endQuery(*statisticsQueryPool, currentFrame);
+        }
+    }
+
+    // Sorts the snapshot's objects into the current frame's instance buffer
+    void prepareDraws(const FrameSnapshot &snapshot)
+    {
+        transformTimes.record(snapshot.transformTime);
+
+        auto count = static_cast<uint32_t>(snapshot.objectTransforms.size());
+        reserveObjectBuffers(count);
+        objectVisible.resize(count);
+        if (enableFrustumCulling)
+        {
+            auto cullStart = std::chrono::steady_clock::now();
+            auto frustum = Frustum::fromMatrix(snapshot.ubo.proj * snapshot.ubo.view);
+            jobSystem.parallelFor(count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+                                  { cullBoxes(snapshot.objectBounds, frustum, begin, end, objectVisible.data()); });
+            cullTimes.record(std::chrono::steady_clock::now() - cullStart);
+        }
+        else
+        {
+            std::ranges::fill(objectVisible, 1);
+        }
+
+        drawList.clear();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!objectVisible[i])
+            {
+                continue;
+            }
+
+            // Distance along the view direction. Non-negative floats order the
+            // same as their bit patterns, which leaves the high bits free.
+            // -0.0f and NaN would set the sign bit, both become 0
+            auto viewPosition = snapshot.ubo.view * snapshot.objectTransforms[i][3];
+            float depth = -viewPosition.z > 0.0f ? -viewPosition.z : 0.0f;
+
+            // Pipelines take the top 24 bits, the index type's size in bytes
+            // the next 8
+            uint64_t pipeline = materials[snapshot.objectMaterials[i]].pipeline;
+            uint32_t mesh = selectLod(snapshot.objectMeshes[i], snapshot.objectTransforms[i], depth, snapshot);
+            uint64_t indexSize = IndexData::indexSize(meshes[mesh].indexType);
+            drawList.push_back({
+                .sortKey = pipeline << 40 | indexSize << 32 | std::bit_cast<uint32_t>(depth),
+                .object = i,
+                .mesh = mesh,
+            });
+        }
+
+        if (enableDrawSorting)
+        {
+            std::ranges::sort(drawList, {}, &DrawItem::sortKey);
+        }
+
+        // Only positions whose entity, level of detail or transform differ
+        // from what this frame slot last wrote are uploaded
+        auto instances = static_cast<InstanceData *>(instanceBuffersMapped[currentFrame]);
+        auto &uploaded = uploadedInstances[currentFrame];
+        uploaded.resize(drawList.size());
+        std::vector<DrawBatch> batches;
+        for (uint32_t i = 0; i < drawList.size(); ++i)
+        {
+            auto &item = drawList[i];
+            UploadedInstance current{.entity = snapshot.objectEntities[item.object], .mesh = item.mesh, .version = snapshot.objectVersions[item.object]};
+            if (uploaded[i].entity != current.entity || uploaded[i].mesh != current.mesh || uploaded[i].version != current.version)
+            {
+                instances[i].model = snapshot.objectTransforms[item.object] * meshes[item.mesh].dequantize;
+                uploaded[i] = current;
+                ++instancesUploaded;
+            }
+
+            auto pipeline = static_cast<uint32_t>(item.sortKey >> 40);
+            if (batches.empty() || batches.back().pipeline != pipeline || batches.back().mesh != item.mesh)
+            {
+                batches.push_back({.pipeline = pipeline, .mesh = item.mesh, .firstInstance = i, .instanceCount = 0});
+            }
+            ++batches.back().instanceCount;
+        }
+
+        auto commands = static_cast<vk::DrawIndexedIndirectCommand *>(indirectBuffersMapped[currentFrame]);
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            auto &mesh = meshes[batches[i].mesh];
+            commands[i] = {
+                .indexCount = mesh.indexCount,
+                .instanceCount = batches[i].instanceCount,
+                .firstIndex = mesh.firstIndex,
+                .vertexOffset = mesh.vertexOffset,
+                .firstInstance = batches[i].firstInstance,
+            };
+        }
+
+        if (batches != drawBatches)
+        {
+            drawBatches = std::move(batches);
+            markSceneDirty();
+        }
+
+        if (useMeshletCulling)
+        {
+            prepareMeshletCull(snapshot);
+        }
+    }
+
+    // One cull task per sorted object, draw commands follow the same order
+    void prepareMeshletCull(const FrameSnapshot &snapshot)
+    {
+        auto tasks = static_cast<MeshletCullTask *>(meshletCullTaskBuffersMapped[currentFrame]);
+        uint32_t commandCount = 0;
+        std::vector<IndexTypeRun> runs;
+        for (uint32_t i = 0; i < drawList.size(); ++i)
+        {
+            auto &mesh = meshes[drawList[i].mesh];
+            appendIndexTypeRun(runs, mesh.indexType, mesh.meshletCount);
+            tasks[i] = {
+                .transform = snapshot.objectTransforms[drawList[i].object],
+                .sphere = mesh.bounds,
+                .firstMeshlet = mesh.firstMeshlet,
+                .meshletCount = mesh.meshletCount,
+                .firstCommand = commandCount,
+                .instance = i,
+                .vertexOffset = mesh.vertexOffset,
+            };
+            commandCount += mesh.meshletCount;
+        }
+
+        reserveMeshletDraws(commandCount);
+
+        auto taskCount = static_cast<uint32_t>(drawList.size());
+        if (taskCount != meshletCullTaskCount || commandCount != meshletDrawCount || runs != meshletDrawRuns)
+        {
+            meshletCullTaskCount = taskCount;
+            meshletDrawCount = commandCount;
+            meshletDrawRuns = std::move(runs);
+            markSceneDirty();
+        }
+
+        *static_cast<OcclusionCullData *>(occlusionCullBuffersMapped[currentFrame]) = {
+            .previousView = previousCamera.view,
+            .previousProj = previousCamera.proj,
+            .pyramidSize = glm::vec2(depthPyramidExtent.width, depthPyramidExtent.height),
+            .pyramidLevels = depthPyramidLevels,
+            .enabled = useOcclusionCulling && depthPyramidValid,
+        };
+
+        // This frame builds the pyramid the next one tests against
+        previousCamera = snapshot.ubo;
+        depthPyramidValid = useOcclusionCulling;
+    }
+
+    // Reads the counts of the last submission from this frame slot and
+    // clears them for the next
+    void collectCullStatistics()
+    {
+        if (!useMeshletCulling || frameSlotNumbers[currentFrame] == 0)
+        {
+            return;
+        }
+
+        auto statistics = static_cast<CullStatistics *>(cullStatisticsBuffersMapped[currentFrame]);
+        frustumCulledObjects += statistics->frustumCulledObjects;
+        occludedObjects += statistics->occludedObjects;
+        ++cullStatisticsFrames;
+        *statistics = {};
+    }
+
+    void recordMeshletCull(const vk::raii::CommandBuffer &commandBuffer)
+    {
+        std::vector<vk::DescriptorSet> sets{*meshletCullDescriptorSets[currentFrame]};
+        if (useOcclusionCulling)
+        {
+            sets.push_back(*depthPyramidDescriptorSets.back());
+        }
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *meshletCullPipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *meshletCullPipelineLayout, 0, sets, nullptr);
+        commandBuffer.dispatch(meshletCullTaskCount, 1, 1);
+    }
+
+    // Each level reads the one written just before
+    void recordDepthPyramid(const vk::raii::CommandBuffer &commandBuffer)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *depthPyramidPipeline);
+
+        for (uint32_t level = 0; level < depthPyramidLevels; ++level)
+        {
+            if (level > 0)
+            {
+                vk::MemoryBarrier2 barrier{
+                    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+                    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+                    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+                    .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+                };
+                commandBuffer.pipelineBarrier2({
+                    .memoryBarrierCount = 1,
+                    .pMemoryBarriers = &barrier,
+                });
+            }
+
+            commandBuffer.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute,
+                *depthPyramidPipelineLayout, 0, {*depthPyramidDescriptorSets[level]}, nullptr);
+
+            uint32_t width = std::max(depthPyramidExtent.width >> level, 1u);
+            uint32_t height = std::max(depthPyramidExtent.height >> level, 1u);
+            commandBuffer.dispatch((width + 7) / 8, (height + 7) / 8, 1);
+        }
+    }
+
+    // Coarsest level of mesh whose error projects to at most LOD_ERROR_PIXELS
+    // at the given view depth
+    uint32_t selectLod(uint32_t mesh, const glm::mat4 &transform, float depth, const FrameSnapshot &snapshot) const
+    {
+        if (!enableMeshLods || depth <= 0.0f)
+        {
+            return mesh;
+        }
+
+        float scale = std::max({glm::length(glm::vec3(transform[0])),
+                                glm::length(glm::vec3(transform[1])),
+                                glm::length(glm::vec3(transform[2]))});
+        float pixelsPerUnit = std::abs(snapshot.ubo.proj[1][1]) * snapshot.framebufferExtent.height * 0.5f / depth;
+
+        uint32_t lod = mesh;
+        for (uint32_t i = 1; i < meshes[mesh].lodCount; ++i)
+        {
+            if (meshes[mesh + i].error * scale * pixelsPerUnit > LOD_ERROR_PIXELS)
+            {
+                break;
+            }
+            lod = mesh + i;
+        }
+        return lod;
+    }
+
+    // Reads the count written by the last submission from this frame slot
+    void collectPipelineStatistics()
+    {
+        if (!optionalFeatures.pipelineStatistics || frameSlotNumbers[currentFrame] == 0)
+        {
+            return;
+        }
+
+        auto [result, invocations] = statisticsQueryPool.getResult<uint64_t>(
+            currentFrame, 1, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+        if (result == vk::Result::eSuccess)
+        {
+            fragmentInvocations += invocations;
+            ++statisticsFrames;
+        }
+    }
+
+    void drawFrame(const FrameSnapshot &snapshot)
+    {
+        if (snapshot.framebufferExtent.width == 0 || snapshot.framebufferExtent.height == 0)
+        {
+            // Minimized, there is nothing to present to
+            return;
+        }
+        framebufferExtent = snapshot.framebufferExtent;
+
+        if (logicalDevice.waitForFences(*inFlightFences[currentFrame], VK_TRUE, UINT64_MAX) != vk::Result::eSuccess)
+        {
+            std::cerr << "DrawFrame:\tCould not wait for fences\n";
+        }
+
+        completedFrameNumber = std::max(completedFrameNumber, frameSlotNumbers[currentFrame]);
+        deletionQueue.collect(completedFrameNumber);
+
+        auto [result, imageIndex] = swapchain.acquireNextImage(UINT64_MAX, *imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE);
+
+        if (result == vk::Result::eErrorOutOfDateKHR)
+        {
+            recreateSwapchain();
+            return;
+        }
+        else if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR)
+        {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+
+        logicalDevice.resetFences(*inFlightFences[currentFrame]);
+
+        collectPipelineStatistics();
+        collectCullStatistics();
+        if (depthPrepassRequested != useDepthPrepass)
+        {
+            setDepthPrepass(depthPrepassRequested);
+        }
+        prepareDraws(snapshot);
+
+        vk::CommandBuffer commandBuffer;
+        if (enableStaticScene)
+        {
+            // Only ever submitted from this frame slot, whose fence was waited on above
+            size_t index = currentFrame * swapchainImageViews.size() + imageIndex;
+            if (staticCommandBuffersDirty[index])
+            {
+                recordCommandBuffer(staticCommandBuffers[index], imageIndex);
+                staticCommandBuffersDirty[index] = false;
+            }
+            commandBuffer = *staticCommandBuffers[index];
+        }
+        else
+        {
+            frameCommandPools[currentFrame].reset();
+
+            auto &frameCommandBuffer = frameCommandPools[currentFrame].acquire();
+            recordCommandBuffer(frameCommandBuffer, imageIndex);
+            commandBuffer = *frameCommandBuffer;
+        }
+
+        std::array waitSemaphores{*imageAvailableSemaphores[currentFrame]};
+        std::array<vk::PipelineStageFlags, waitSemaphores.size()> waitStages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
+
+        std::array signalSemaphores{*renderFinishedSemaphores[currentFrame]};
+
+        updateUniformBuffer(currentFrame, snapshot.ubo);
+
+        vk::SubmitInfo submitInfo{
+            .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+            .pWaitSemaphores = waitSemaphores.data(),
+            .pWaitDstStageMask = waitStages.data(),
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+            .signalSemaphoreCount = signalSemaphores.size(),
+            .pSignalSemaphores = signalSemaphores.data(),
+        };
+
+        graphicsQueue.submit({submitInfo}, *inFlightFences[currentFrame]);
+        frameSlotNumbers[currentFrame] = ++frameNumber;
+
+        std::array swapchains = {*swapchain};
+        vk::PresentIdKHR presentId{
+            .swapchainCount = swapchains.size(),
+            .pPresentIds = &frameNumber,
+        };
+        vk::PresentInfoKHR presentInfo{
+            .pNext = optionalFeatures.presentWait ? &presentId : nullptr,
+            .waitSemaphoreCount = signalSemaphores.size(),
+            .pWaitSemaphores = signalSemaphores.data(),
+            .swapchainCount = swapchains.size(),
+            .pSwapchains = swapchains.data(),
+            .pImageIndices = &imageIndex,
+        };
+        VkPresentInfoKHR info = presentInfo;
+
+        result = vk::Result(vkQueuePresentKHR(*presentQueue, &info));
+        // result = presentQueue.presentKHR(presentInfo);
+
+        if (optionalFeatures.presentWait)
+        {
+            pendingPresent = {frameNumber, snapshot.inputTime};
+        }
+        else
+        {
+            inputLatency.record(std::chrono::steady_clock::now() - snapshot.inputTime);
+        }
+        if (framebufferResized.exchange(false) || result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
+        {
+            recreateSwapchain();
+        }
+        else if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to present swap chain image!");
+        }
+
+        framePacer.endFrame();
+        reportFrameStats();
+
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    void recreateSwapchain()
+    {
+        auto currentExtent = physicalDevice.getSurfaceCapabilitiesKHR(*surface).currentExtent;
+        if (currentExtent.width == 0 || currentExtent.height == 0)
+        {
+            // A zero sized swapchain is invalid, retry once the window is restored
+            framebufferResized = true;
+            return;
+        }
+
+        // Present ids are per swapchain
+        pendingPresent.presentId = 0;
+
+        // No waitIdle, frames in flight keep using the old objects until they retire
+        retire(std::move(staticCommandBuffers));
+        retire(std::move(swapchainFrameBuffers));
+        retire(std::move(swapchainImageViews));
+
+        vk::SwapchainKHR oldSwapchain = *swapchain;
+        retire(std::move(swapchain));
+
+        createSwapchain(oldSwapchain);
+        createDepthResources();
+        createFrameBuffers();
+        createRenderGraph();
+
+        if (enableStaticScene)
+        {
+            createStaticCommandBuffers();
+        }
     }
 
-    void createVertexBuffer()
+    void createStaticCommandBuffers()
     {
-        vk::DeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+        staticCommandBuffers.clear();
+        staticCommandBuffers = logicalDevice.allocateCommandBuffers({
+            .commandPool = *staticCommandPool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * swapchainImageViews.size()),
+        });
 
-        auto [stagingBuffer, stagingBufferMemory] = createBuffer(
-            bufferSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        markSceneDirty();
+    }
 
-        auto data = stagingBufferMemory.mapMemory(0, bufferSize);
-        memcpy(data, vertices.data(), bufferSize);
-        stagingBufferMemory.unmapMemory();
+    // Destroys resource once the GPU is done with every frame submitted so
+    // far, including the one currently being recorded
+    template <typename T>
+    void retire(T &&resource)
+    {
+        deletionQueue.retire(frameNumber + 1, std::forward<T>(resource));
+    }
+
+    // Call whenever something recorded into the static command buffers changes
+    void markSceneDirty()
+    {
+        staticCommandBuffersDirty.assign(staticCommandBuffers.size(), true);
+    }
+
+    std::optional<uint32_t> tryFindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+    {
+        auto memoryProperties = physicalDevice.getMemoryProperties();
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+        {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+    {
+        if (auto memoryType = tryFindMemoryType(typeFilter, properties))
+        {
+            return *memoryType;
+        }
+
+        throw std::runtime_error("Failed to find a suitable memory type!");
+    }
+
+    std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> createBuffer(
+        vk::DeviceSize size,
+        vk::BufferUsageFlags usage,
+        vk::MemoryPropertyFlags properties)
+    {
+        auto buffer = logicalDevice.createBuffer({
+            .size = size,
+            .usage = usage,
+            .sharingMode = vk::SharingMode::eExclusive,
+        });
+
+        auto memoryRequirements = buffer.getMemoryRequirements();
+
+        auto memory = logicalDevice.allocateMemory({
+            .allocationSize = size,
+            .memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties),
+        });
+
+        buffer.bindMemory(*memory, 0);
+
+        return std::make_pair(std::move(buffer), std::move(memory));
+    }
+
+    // Doesn't wait for the copy. Queue order makes the result visible to every
+    // frame submitted afterwards, so srcBuffer only has to be retired
+    void copyBuffer(const vk::raii::Buffer &srcBuffer, const vk::raii::Buffer &dstBuffer, vk::DeviceSize size,
+                    vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0)
+    {
+        vk::CommandBufferAllocateInfo allocateInfo{
+            .commandPool = *commandPool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1,
+        };
+
+        auto commandBuffers = logicalDevice.allocateCommandBuffers(allocateInfo);
+        auto &commandBuffer = commandBuffers.front();
+
+        commandBuffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        commandBuffer.copyBuffer(*srcBuffer, *dstBuffer, vk::BufferCopy{
+            .srcOffset = srcOffset,
+            .dstOffset = dstOffset,
+            .size = size,
+        });
+
+        vk::MemoryBarrier barrier{
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eMemoryRead,
+        };
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+            {}, barrier, nullptr, nullptr);
+
+        commandBuffer.end();
+
+        graphicsQueue.submit({vk::SubmitInfo{
+            .commandBufferCount = 1,
+            .pCommandBuffers = &*commandBuffer,
+        }});
+
+        retire(std::move(commandBuffer));
+    }
+
+    void loadSceneMesh()
+    {
+        if (*MODEL_PATH == '\0')
+        {
+            return;
+        }
+
+        auto milliseconds = [](auto duration)
+        {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        MappedFile source(MODEL_PATH);
+        uint64_t sourceHash = hashBytes({source.data(), source.size()});
+        auto cachePath = meshCachePath(MESH_CACHE_DIR, sourceHash);
+        MeshCacheSettings cacheSettings{
+            .maxLods = enableMeshLods ? MAX_MESH_LODS : 0,
+            .maxLodError = enableMeshLods ? MAX_LOD_ERROR : 0.0f,
+        };
+        if (enableMeshCache)
+        {
+            if (auto cached = loadMeshCache(cachePath, sourceHash, cacheSettings))
+            {
+                sceneMesh = std::move(*cached);
+                std::cout << "Loaded " << MODEL_PATH << " from " << cachePath.string() << ": "
+                          << sceneMesh.indices.size() / 3 << " triangles, " << sceneMesh.vertices.size()
+                          << " vertices in " << milliseconds(std::chrono::steady_clock::now() - start) << " ms"
+                          << std::endl;
+                return;
+            }
+        }
+
+        auto mesh = importMesh(MODEL_PATH, source.text());
+        if (mesh.indices.empty())
+        {
+            throw std::runtime_error("Mesh " + std::string(MODEL_PATH) + " has no triangles!");
+        }
+        auto imported = std::chrono::steady_clock::now();
+
+        // Fit into the unit cube the scene is laid out for
+        glm::vec3 min = mesh.vertices.front().pos, max = min;
+        for (auto &vertex : mesh.vertices)
+        {
+            min = glm::min(min, vertex.pos);
+            max = glm::max(max, vertex.pos);
+        }
+        float scale = 1.0f / std::max({max.x - min.x, max.y - min.y, max.z - min.z, 1e-6f});
+        for (auto &vertex : mesh.vertices)
+        {
+            vertex.pos = (vertex.pos - (min + max) * 0.5f) * scale;
+        }
+
+        size_t importedVertices = mesh.vertices.size();
+        deduplicateVertices(mesh.vertices, mesh.indices);
+        float acmrBefore = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+        optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        optimizeVertexFetch(mesh.vertices, mesh.indices);
+        float acmrAfter = averageCacheMissRatio(mesh.indices, mesh.vertices.size());
+        auto optimized = std::chrono::steady_clock::now();
+
+        std::cout << "Loaded " << MODEL_PATH << ": " << mesh.indices.size() / 3 << " triangles, "
+                  << importedVertices << " -> " << mesh.vertices.size() << " vertices, import "
+                  << milliseconds(imported - start) << " ms, optimize " << milliseconds(optimized - imported)
+                  << " ms, ACMR " << acmrBefore << " -> " << acmrAfter << std::endl;
+
+        if (enableMeshLods)
+        {
+            auto lodStart = std::chrono::steady_clock::now();
+            generateLods(mesh, MAX_MESH_LODS, MAX_LOD_ERROR);
+            std::cout << "Generated " << mesh.lods.size() - 1 << " levels of detail in "
+                      << milliseconds(std::chrono::steady_clock::now() - lodStart) << " ms:";
+            for (auto &lod : mesh.lods)
+            {
+                std::cout << ' ' << lod.indexCount / 3 << " (" << lod.error << ')';
+            }
+            std::cout << std::endl;
+        }
+
+        // Without a writable cache directory every run imports the mesh again
+        if (enableMeshCache)
+        {
+            try
+            {
+                writeMeshCache(cachePath, sourceHash, cacheSettings, mesh);
+            }
+            catch (const std::exception &error)
+            {
+                std::cerr << "Could not write mesh cache: " << error.what() << '\n';
+            }
+        }
+        sceneMesh = std::move(mesh);
+    }
+
+    void createGeometryBuffers()
+    {
+        uint32_t vertexCapacity = std::max(GEOMETRY_BUFFER_VERTICES, static_cast<uint32_t>(sceneMesh.vertices.size()));
+        uint32_t indexCapacity = std::max(GEOMETRY_BUFFER_INDICES, static_cast<uint32_t>(sceneMesh.indices.size()));
 
-        std::tie(vertexBuffer, vertexBufferMemory) = createBuffer(
-            bufferSize,
+        std::tie(geometryVertexBuffer, geometryVertexMemory) = createBuffer(
+            vertexCapacity * sizeof(SceneVertex),
             vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
             vk::MemoryPropertyFlagBits::eDeviceLocal);
+        geometryVertices = RangeAllocator(vertexCapacity);
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        std::tie(geometryIndexBuffer, geometryIndexMemory) = createBuffer(
+            indexCapacity * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        geometryIndices = RangeAllocator(indexCapacity);
+
+        if (useMeshletCulling)
+        {
+            // Each level of detail may end in one partly filled meshlet
+            auto meshletCapacity = static_cast<uint32_t>(std::max<size_t>(
+                GEOMETRY_BUFFER_MESHLETS,
+                maxMeshletCount(sceneMesh.indices.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES) + sceneMesh.lods.size()));
+
+            std::tie(geometryMeshletBuffer, geometryMeshletMemory) = createBuffer(
+                meshletCapacity * sizeof(Meshlet),
+                vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal);
+            geometryMeshlets = RangeAllocator(meshletCapacity);
+        }
     }
 
-    void createIndexBuffer()
+    // Copies mesh into free ranges of the geometry buffers, returns the index
+    // of its full detail level in meshes
+    uint32_t uploadMesh(const MeshData &mesh)
     {
-        vk::DeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+        if (mesh.indices.empty())
+        {
+            throw std::runtime_error("Can't upload a mesh without triangles!");
+        }
+
+        auto packed = packVertices<SceneVertex>(mesh.vertices);
+        auto indexData = IndexData::pack(mesh.indices, optionalFeatures.indexTypeUint8);
+        auto indexSize = IndexData::indexSize(indexData.type);
+        auto indexWords = static_cast<uint32_t>((indexData.bytes.size() + 3) / 4);
+
+        auto lods = mesh.lods;
+        if (lods.empty())
+        {
+            lods.push_back({.firstIndex = 0, .indexCount = indexData.count, .error = 0.0f});
+        }
+
+        // Meshlets of every level, firstIndex relative to the mesh for now
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> lodFirstMeshlets;
+        if (useMeshletCulling)
+        {
+            for (auto &lod : lods)
+            {
+                lodFirstMeshlets.push_back(static_cast<uint32_t>(meshlets.size()));
+                auto lodIndices = std::span(mesh.indices).subspan(lod.firstIndex, lod.indexCount);
+                for (auto &meshlet : buildMeshlets(mesh.vertices, lodIndices, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES))
+                {
+                    meshlet.firstIndex += lod.firstIndex;
+                    meshlets.push_back(meshlet);
+                }
+            }
+            lodFirstMeshlets.push_back(static_cast<uint32_t>(meshlets.size()));
+        }
+
+        auto bounds = boundingSphere(mesh.vertices, mesh.indices);
+        auto vertexCount = static_cast<uint32_t>(packed.vertices.size());
+        auto meshletCount = static_cast<uint32_t>(meshlets.size());
+        auto vertexOffset = geometryVertices.allocate(vertexCount);
+        auto firstIndexWord = geometryIndices.allocate(indexWords);
+        auto firstMeshlet = useMeshletCulling ? geometryMeshlets.allocate(meshletCount) : std::optional<uint32_t>(0);
+        if (!vertexOffset || !firstIndexWord || !firstMeshlet)
+        {
+            if (vertexOffset)
+            {
+                geometryVertices.free(*vertexOffset, vertexCount);
+            }
+            if (firstIndexWord)
+            {
+                geometryIndices.free(*firstIndexWord, indexWords);
+            }
+            if (firstMeshlet && useMeshletCulling)
+            {
+                geometryMeshlets.free(*firstMeshlet, meshletCount);
+            }
+            throw std::runtime_error("Geometry buffers are full!");
+        }
+
+        vk::DeviceSize indexOffset = *firstIndexWord * vk::DeviceSize(4);
+        auto firstIndex = static_cast<uint32_t>(indexOffset / indexSize);
+        for (auto &meshlet : meshlets)
+        {
+            meshlet.firstIndex += firstIndex;
+        }
 
+        // Vertices, indices then meshlets in one staging buffer
+        vk::DeviceSize vertexBytes = sizeof(SceneVertex) * packed.vertices.size();
+        vk::DeviceSize indexBytes = indexData.bytes.size();
+        vk::DeviceSize meshletBytes = sizeof(Meshlet) * meshlets.size();
+        vk::DeviceSize stagingSize = vertexBytes + indexBytes + meshletBytes;
         auto [stagingBuffer, stagingBufferMemory] = createBuffer(
-            bufferSize,
+            stagingSize,
             vk::BufferUsageFlagBits::eTransferSrc,
             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
 
-        auto data = stagingBufferMemory.mapMemory(0, bufferSize);
-        memcpy(data, indices.data(), bufferSize);
+        auto data = static_cast<std::byte *>(stagingBufferMemory.mapMemory(0, stagingSize));
+        memcpy(data, packed.vertices.data(), vertexBytes);
+        memcpy(data + vertexBytes, indexData.bytes.data(), indexBytes);
+        if (meshletBytes > 0)
+        {
+            memcpy(data + vertexBytes + indexBytes, meshlets.data(), meshletBytes);
+        }
         stagingBufferMemory.unmapMemory();
 
-        std::tie(indexBuffer, indexBufferMemory) = createBuffer(
-            bufferSize,
-            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        copyBuffer(stagingBuffer, geometryVertexBuffer, vertexBytes, 0, *vertexOffset * sizeof(SceneVertex));
+        copyBuffer(stagingBuffer, geometryIndexBuffer, indexBytes, vertexBytes, indexOffset);
+        if (meshletBytes > 0)
+        {
+            copyBuffer(stagingBuffer, geometryMeshletBuffer, meshletBytes, vertexBytes + indexBytes,
+                       *firstMeshlet * sizeof(Meshlet));
+        }
+        retire(std::move(stagingBuffer));
+        retire(std::move(stagingBufferMemory));
 
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+        auto firstLod = static_cast<uint32_t>(meshes.size());
+        for (size_t i = 0; i < lods.size(); ++i)
+        {
+            meshes.push_back({
+                .vertexOffset = static_cast<int32_t>(*vertexOffset),
+                .vertexCount = vertexCount,
+                .firstIndex = firstIndex + lods[i].firstIndex,
+                .indexCount = lods[i].indexCount,
+                .indexType = indexData.type,
+                .indexOffset = indexOffset + lods[i].firstIndex * indexSize,
+                .dequantize = packed.dequantize,
+                .lodCount = static_cast<uint32_t>(lods.size() - i),
+                .error = lods[i].error,
+                .firstMeshlet = useMeshletCulling ? *firstMeshlet + lodFirstMeshlets[i] : 0,
+                .meshletCount = useMeshletCulling ? lodFirstMeshlets[i + 1] - lodFirstMeshlets[i] : 0,
+                .bounds = bounds,
+            });
+        }
+        markSceneDirty();
+        return firstLod;
     }
 
     void createDescriptorSetLayout()
@@ -934,34 +3310,187 @@ private:
         }
     }
 
-    void updateUniformBuffer(uint32_t currentImage)
+    // Sized for the renderables of the initial scene, reserveObjectBuffers
+    // grows them when more are added
+    void createObjectBuffers()
+    {
+        auto capacity = static_cast<uint32_t>(entities.count<SceneNodeComponent, MeshComponent, MaterialComponent>());
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            instanceBuffers.emplace_back(nullptr);
+            instanceBuffersMemory.emplace_back(nullptr);
+            instanceBuffersMapped.push_back(nullptr);
+            indirectBuffers.emplace_back(nullptr);
+            indirectBuffersMemory.emplace_back(nullptr);
+            indirectBuffersMapped.push_back(nullptr);
+            if (useMeshletCulling)
+            {
+                meshletCullTaskBuffers.emplace_back(nullptr);
+                meshletCullTaskBuffersMemory.emplace_back(nullptr);
+                meshletCullTaskBuffersMapped.push_back(nullptr);
+            }
+            resizeObjectBuffers(i, std::max(capacity, 1u));
+        }
+    }
+
+    // Replaces frame's instance, indirect (at most one batch per object) and
+    // cull task buffers with ones holding capacity objects. The old ones are
+    // retired, nothing of their contents is kept
+    void resizeObjectBuffers(size_t frame, uint32_t capacity)
     {
-        static auto startTime = std::chrono::high_resolution_clock::now();
+        auto replace = [&](vk::raii::Buffer &buffer, vk::raii::DeviceMemory &memory, void *&mapped,
+                           vk::DeviceSize size, vk::BufferUsageFlags usage)
+        {
+            retire(std::move(buffer));
+            retire(std::move(memory));
+            std::tie(buffer, memory) = createBuffer(
+                size, usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+            mapped = memory.mapMemory(0, size);
+        };
+
+        replace(instanceBuffers[frame], instanceBuffersMemory[frame], instanceBuffersMapped[frame],
+                sizeof(InstanceData) * capacity, vk::BufferUsageFlagBits::eVertexBuffer);
+        replace(indirectBuffers[frame], indirectBuffersMemory[frame], indirectBuffersMapped[frame],
+                sizeof(vk::DrawIndexedIndirectCommand) * capacity, vk::BufferUsageFlagBits::eIndirectBuffer);
+        if (useMeshletCulling)
+        {
+            replace(meshletCullTaskBuffers[frame], meshletCullTaskBuffersMemory[frame], meshletCullTaskBuffersMapped[frame],
+                    sizeof(MeshletCullTask) * capacity, vk::BufferUsageFlagBits::eStorageBuffer);
+        }
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        objectCapacities[frame] = capacity;
+        uploadedInstances[frame].clear();
+    }
 
-        UniformBufferObject ubo{
-            .model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-            .view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-            .proj = glm::perspective(glm::radians(45.0f), swapchainExtent.width / static_cast<float>(swapchainExtent.height), 0.1f, 10.0f)};
+    // Grows the current frame slot's object buffers to at least twice their
+    // size when count objects don't fit. Its last submission has finished,
+    // the other slots keep their buffers until they come round
+    void reserveObjectBuffers(uint32_t count)
+    {
+        if (count <= objectCapacities[currentFrame])
+        {
+            return;
+        }
+
+        resizeObjectBuffers(currentFrame, std::max(count, objectCapacities[currentFrame] * 2));
+        if (useMeshletCulling)
+        {
+            writeMeshletCullDescriptorSet(currentFrame);
+        }
+        markSceneDirty();
+    }
+
+    // Like reserveObjectBuffers for the meshlet draw buffer
+    void reserveMeshletDraws(uint32_t count)
+    {
+        if (count <= meshletDrawCapacities[currentFrame])
+        {
+            return;
+        }
+
+        resizeMeshletDrawBuffer(currentFrame, std::max(count, meshletDrawCapacities[currentFrame] * 2));
+        writeMeshletCullDescriptorSet(currentFrame);
+        markSceneDirty();
+    }
+
+    void resizeMeshletDrawBuffer(size_t frame, uint32_t capacity)
+    {
+        retire(std::move(meshletDrawBuffers[frame]));
+        retire(std::move(meshletDrawBuffersMemory[frame]));
+        std::tie(meshletDrawBuffers[frame], meshletDrawBuffersMemory[frame]) = createBuffer(
+            sizeof(vk::DrawIndexedIndirectCommand) * capacity,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        meshletDrawCapacities[frame] = capacity;
+    }
+
+    void createMeshletCullBuffers()
+    {
+        if (!useMeshletCulling)
+        {
+            return;
+        }
+
+        // One command slot per meshlet of the finest level, coarser levels
+        // have fewer. Tasks live with the other object buffers
+        uint32_t meshletDrawCapacity = 0;
+        entities.forEach<MeshComponent, SceneNodeComponent, MaterialComponent>(
+            [&](size_t rows, const Entity *, MeshComponent *meshComponents, SceneNodeComponent *, MaterialComponent *)
+            {
+                for (size_t row = 0; row < rows; ++row)
+                {
+                    meshletDrawCapacity += meshes[meshComponents[row].mesh].meshletCount;
+                }
+            });
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            meshletDrawBuffers.emplace_back(nullptr);
+            meshletDrawBuffersMemory.emplace_back(nullptr);
+            resizeMeshletDrawBuffer(i, std::max(meshletDrawCapacity, 1u));
+
+            auto [statisticsBuffer, statisticsBufferMemory] = createBuffer(
+                sizeof(CullStatistics),
+                vk::BufferUsageFlagBits::eStorageBuffer,
+                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+            cullStatisticsBuffersMapped.push_back(statisticsBufferMemory.mapMemory(0, sizeof(CullStatistics)));
+            *static_cast<CullStatistics *>(cullStatisticsBuffersMapped.back()) = {};
+
+            cullStatisticsBuffers.push_back(std::move(statisticsBuffer));
+            cullStatisticsBuffersMemory.push_back(std::move(statisticsBufferMemory));
+
+            auto [occlusionBuffer, occlusionBufferMemory] = createBuffer(
+                sizeof(OcclusionCullData),
+                vk::BufferUsageFlagBits::eUniformBuffer,
+                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+            occlusionCullBuffersMapped.push_back(occlusionBufferMemory.mapMemory(0, sizeof(OcclusionCullData)));
+
+            occlusionCullBuffers.push_back(std::move(occlusionBuffer));
+            occlusionCullBuffersMemory.push_back(std::move(occlusionBufferMemory));
+        }
+    }
+
+    void createStatisticsQueryPool()
+    {
+        if (!optionalFeatures.pipelineStatistics)
+        {
+            return;
+        }
+
+        statisticsQueryPool = logicalDevice.createQueryPool({
+            .queryType = vk::QueryType::ePipelineStatistics,
+            .queryCount = MAX_FRAMES_IN_FLIGHT,
+            .pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations,
+        });
+    }
 
-        ubo.proj[1][1] *= -1;
+    void updateUniformBuffer(uint32_t currentImage, const UniformBufferObject &ubo)
+    {
         memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
     }
 
     void createDescriptorPool()
     {
-        vk::DescriptorPoolSize poolSize{
-            .type = vk::DescriptorType::eUniformBuffer,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT,
-            };
+        // The meshlet cull sets take another two uniform buffers and four
+        // storage buffers each
+        std::array poolSizes{
+            vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eUniformBuffer,
+                .descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT,
+            },
+            vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT,
+            },
+        };
 
         descriptorPool = logicalDevice.createDescriptorPool({
             .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-            .maxSets = MAX_FRAMES_IN_FLIGHT,
-            .poolSizeCount = 1,
-            .pPoolSizes = &poolSize,
+            .maxSets = 2 * MAX_FRAMES_IN_FLIGHT,
+            .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+            .pPoolSizes = poolSizes.data(),
         });
     }
 
@@ -994,5 +3523,54 @@ private:
 
             logicalDevice.updateDescriptorSets({descriptorWrite}, nullptr);
         }
+
+        if (useMeshletCulling)
+        {
+            createMeshletCullDescriptorSets();
+        }
+    }
+
+    void createMeshletCullDescriptorSets()
+    {
+        std::vector<vk::DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, *meshletCullDescriptorSetLayout);
+
+        meshletCullDescriptorSets = logicalDevice.allocateDescriptorSets({
+            .descriptorPool = *descriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+            .pSetLayouts = layouts.data(),
+        });
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        {
+            writeMeshletCullDescriptorSet(i);
+        }
+    }
+
+    // Also after the frame's buffers were replaced, while it isn't in flight
+    void writeMeshletCullDescriptorSet(size_t frame)
+    {
+        std::array bufferInfos{
+            vk::DescriptorBufferInfo{.buffer = *uniformBuffers[frame], .offset = 0, .range = sizeof(UniformBufferObject)},
+            vk::DescriptorBufferInfo{.buffer = *geometryMeshletBuffer, .offset = 0, .range = vk::WholeSize},
+            vk::DescriptorBufferInfo{.buffer = *meshletCullTaskBuffers[frame], .offset = 0, .range = vk::WholeSize},
+            vk::DescriptorBufferInfo{.buffer = *meshletDrawBuffers[frame], .offset = 0, .range = vk::WholeSize},
+            vk::DescriptorBufferInfo{.buffer = *cullStatisticsBuffers[frame], .offset = 0, .range = sizeof(CullStatistics)},
+            vk::DescriptorBufferInfo{.buffer = *occlusionCullBuffers[frame], .offset = 0, .range = sizeof(OcclusionCullData)},
+        };
+
+        std::vector<vk::WriteDescriptorSet> descriptorWrites;
+        for (uint32_t binding = 0; binding < bufferInfos.size(); ++binding)
+        {
+            descriptorWrites.push_back({
+                .dstSet = *meshletCullDescriptorSets[frame],
+                .dstBinding = binding,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = binding == 0 || binding == 5 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer,
+                .pBufferInfo = &bufferInfos[binding],
+            });
+        }
+
+        logicalDevice.updateDescriptorSets(descriptorWrites, nullptr);
     }
 };
\ No newline at end of file
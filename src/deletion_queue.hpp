@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Takes ownership of resources (RAII handles, or containers of them) that
+// may still be referenced by frames in flight, and destroys them once the GPU
+// has finished the last frame that used them. Entries are destroyed in the
+// order they were retired.
+class DeletionQueue
+{
+public:
+    template <typename T>
+    void retire(uint64_t lastUsedFrame, T &&resource)
+    {
+        static_assert(!std::is_lvalue_reference_v<T>, "retire takes ownership, std::move the resource in");
+        using Resource = std::remove_cvref_t<T>;
+
+        entries.push_back({
+            .lastUsedFrame = lastUsedFrame,
+            .resource = Holder(new Resource(std::forward<T>(resource)), [](void *pointer)
+                               { delete static_cast<Resource *>(pointer); }),
+        });
+    }
+
+    // Destroys everything last used by completedFrame or earlier
+    void collect(uint64_t completedFrame)
+    {
+        while (!entries.empty() && entries.front().lastUsedFrame <= completedFrame)
+        {
+            entries.pop_front();
+        }
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    using Holder = std::unique_ptr<void, void (*)(void *)>;
+
+    struct Entry
+    {
+        uint64_t lastUsedFrame;
+        Holder resource;
+    };
+
+    std::deque<Entry> entries;
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Entities grouped by their exact set of component types (archetype). Each
+// archetype stores one array per component type, so iterating a component
+// reads memory linearly and the loops over it vectorize. Adding or removing
+// a component moves the entity to another archetype, removal swaps the last
+// row into the hole. Components must be trivially copyable
+
+using ComponentMask = uint64_t;
+const uint32_t MAX_COMPONENT_TYPES = 64;
+
+inline uint32_t newComponentId()
+{
+    static uint32_t next = 0;
+    if (next == MAX_COMPONENT_TYPES)
+    {
+        throw std::runtime_error("Too many component types!");
+    }
+    return next++;
+}
+
+template <typename T>
+uint32_t componentId()
+{
+    static const uint32_t id = newComponentId();
+    return id;
+}
+
+// index picks the slot, generation tells apart entities reusing it
+struct Entity
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity &) const = default;
+};
+
+struct Archetype
+{
+    struct Column
+    {
+        uint32_t component;
+        size_t elementSize;
+        std::vector<std::byte> data;
+    };
+
+    ComponentMask mask;
+    std::vector<Column> columns;
+    std::vector<Entity> entities;
+
+    Column *column(uint32_t component)
+    {
+        auto found = std::ranges::find(columns, component, &Column::component);
+        return found == columns.end() ? nullptr : &*found;
+    }
+};
+
+class EntityStore
+{
+public:
+    template <typename... Ts>
+    Entity create(const Ts &...components)
+    {
+        (registerComponent<Ts>(), ...);
+
+        Entity entity;
+        if (freeIndices.empty())
+        {
+            entity.index = static_cast<uint32_t>(locations.size());
+            locations.push_back({});
+        }
+        else
+        {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        }
+        entity.generation = locations[entity.index].generation;
+
+        uint32_t archetype = findArchetype((ComponentMask(0) | ... | (ComponentMask(1) << componentId<Ts>())));
+        locations[entity.index].archetype = archetype;
+        locations[entity.index].row = appendRow(archetype, entity);
+        (write(entity, components), ...);
+        return entity;
+    }
+
+    void destroy(Entity entity)
+    {
+        checkAlive(entity);
+        auto &location = locations[entity.index];
+        removeRow(location.archetype, location.row);
+        ++location.generation;
+        freeIndices.push_back(entity.index);
+    }
+
+    bool alive(Entity entity) const
+    {
+        return entity.index < locations.size() && locations[entity.index].generation == entity.generation;
+    }
+
+    // Adds the component or overwrites it when the entity already has one
+    template <typename T>
+    void add(Entity entity, const T &component)
+    {
+        registerComponent<T>();
+        checkAlive(entity);
+        move(entity, archetypes[locations[entity.index].archetype].mask | ComponentMask(1) << componentId<T>());
+        write(entity, component);
+    }
+
+    template <typename T>
+    void remove(Entity entity)
+    {
+        checkAlive(entity);
+        move(entity, archetypes[locations[entity.index].archetype].mask & ~(ComponentMask(1) << componentId<T>()));
+    }
+
+    // Null when the entity has no T. Invalidated by creating, destroying,
+    // adding or removing components
+    template <typename T>
+    T *get(Entity entity)
+    {
+        checkAlive(entity);
+        auto &location = locations[entity.index];
+        auto column = archetypes[location.archetype].column(componentId<T>());
+        return column ? reinterpret_cast<T *>(column->data.data()) + location.row : nullptr;
+    }
+
+    // Calls fn(count, entities, Ts *...) once per archetype holding every Ts,
+    // the arrays are parallel and count long
+    template <typename... Ts, typename F>
+    void forEach(F &&fn)
+    {
+        ComponentMask required = (ComponentMask(0) | ... | (ComponentMask(1) << componentId<Ts>()));
+        for (auto &archetype : archetypes)
+        {
+            if ((archetype.mask & required) == required && !archetype.entities.empty())
+            {
+                fn(archetype.entities.size(), static_cast<const Entity *>(archetype.entities.data()),
+                   reinterpret_cast<Ts *>(archetype.column(componentId<Ts>())->data.data())...);
+            }
+        }
+    }
+
+    // Number of entities holding every Ts
+    template <typename... Ts>
+    size_t count()
+    {
+        size_t total = 0;
+        forEach<Ts...>([&](size_t count, const Entity *, Ts *...)
+                       { total += count; });
+        return total;
+    }
+
+private:
+    struct Location
+    {
+        uint32_t archetype = 0;
+        uint32_t row = 0;
+        uint32_t generation = 0;
+    };
+
+    std::vector<Location> locations;
+    std::vector<uint32_t> freeIndices;
+    std::vector<Archetype> archetypes;
+    std::array<size_t, MAX_COMPONENT_TYPES> componentSizes{};
+
+    template <typename T>
+    void registerComponent()
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Components are moved with memcpy");
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Component columns are only aligned like new");
+        componentSizes[componentId<T>()] = sizeof(T);
+    }
+
+    void checkAlive(Entity entity) const
+    {
+        if (!alive(entity))
+        {
+            throw std::runtime_error("Entity was destroyed!");
+        }
+    }
+
+    template <typename T>
+    void write(Entity entity, const T &component)
+    {
+        *get<T>(entity) = component;
+    }
+
+    uint32_t findArchetype(ComponentMask mask)
+    {
+        auto found = std::ranges::find(archetypes, mask, &Archetype::mask);
+        if (found != archetypes.end())
+        {
+            return static_cast<uint32_t>(found - archetypes.begin());
+        }
+
+        Archetype archetype{.mask = mask};
+        for (uint32_t component = 0; component < MAX_COMPONENT_TYPES; ++component)
+        {
+            if (mask >> component & 1)
+            {
+                archetype.columns.push_back({.component = component, .elementSize = componentSizes[component]});
+            }
+        }
+        archetypes.push_back(std::move(archetype));
+        return static_cast<uint32_t>(archetypes.size() - 1);
+    }
+
+    // New rows are zeroed
+    uint32_t appendRow(uint32_t archetype, Entity entity)
+    {
+        auto &target = archetypes[archetype];
+        for (auto &column : target.columns)
+        {
+            column.data.resize(column.data.size() + column.elementSize);
+        }
+        target.entities.push_back(entity);
+        return static_cast<uint32_t>(target.entities.size() - 1);
+    }
+
+    void removeRow(uint32_t archetype, uint32_t row)
+    {
+        auto &source = archetypes[archetype];
+        auto last = static_cast<uint32_t>(source.entities.size() - 1);
+        if (row != last)
+        {
+            for (auto &column : source.columns)
+            {
+                std::memcpy(column.data.data() + row * column.elementSize, column.data.data() + last * column.elementSize, column.elementSize);
+            }
+            source.entities[row] = source.entities[last];
+            locations[source.entities[row].index].row = row;
+        }
+        for (auto &column : source.columns)
+        {
+            column.data.resize(column.data.size() - column.elementSize);
+        }
+        source.entities.pop_back();
+    }
+
+    // Copies the components both archetypes share
+    void move(Entity entity, ComponentMask mask)
+    {
+        auto &location = locations[entity.index];
+        if (archetypes[location.archetype].mask == mask)
+        {
+            return;
+        }
+
+        uint32_t target = findArchetype(mask);
+        uint32_t row = appendRow(target, entity);
+        for (auto &column : archetypes[target].columns)
+        {
+            if (auto source = archetypes[location.archetype].column(column.component))
+            {
+                std::memcpy(column.data.data() + row * column.elementSize,
+                            source->data.data() + location.row * column.elementSize, column.elementSize);
+            }
+        }
+        removeRow(location.archetype, location.row);
+        location.archetype = target;
+        location.row = row;
+    }
+};
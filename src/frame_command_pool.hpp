@@ -0,0 +1,58 @@
+#pragma once
+
+#define VULKAN_HPP_NO_CONSTRUCTORS
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Transient command pool owned by a single frame in flight. Command buffers
+// are handed out linearly during the frame and the whole pool is reset in
+// one call once the frame's fence has signalled, instead of resetting every
+// buffer individually.
+class FrameCommandPool
+{
+public:
+    FrameCommandPool(const vk::raii::Device &device, uint32_t queueFamilyIndex)
+        : device(&device),
+          pool(device.createCommandPool({
+              .flags = vk::CommandPoolCreateFlagBits::eTransient,
+              .queueFamilyIndex = queueFamilyIndex,
+          }))
+    {
+    }
+
+    // Only call once the GPU is done with every buffer handed out this frame
+    void reset()
+    {
+        pool.reset();
+        used = 0;
+    }
+
+    const vk::raii::CommandBuffer &acquire()
+    {
+        if (used == buffers.size())
+        {
+            // Grow geometrically so steady state never allocates
+            auto count = std::max<uint32_t>(static_cast<uint32_t>(buffers.size()), 1);
+            auto allocated = device->allocateCommandBuffers({
+                .commandPool = *pool,
+                .level = vk::CommandBufferLevel::ePrimary,
+                .commandBufferCount = count,
+            });
+            for (auto &buffer : allocated)
+            {
+                buffers.push_back(std::move(buffer));
+            }
+        }
+
+        return buffers[used++];
+    }
+
+private:
+    const vk::raii::Device *device;
+    vk::raii::CommandPool pool;
+    std::vector<vk::raii::CommandBuffer> buffers;
+    uint32_t used = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+
+// Fixed resolution histogram of durations, 0.25ms buckets up to 250ms
+class DurationHistogram
+{
+public:
+    using Duration = std::chrono::duration<double, std::milli>;
+
+    void record(Duration duration)
+    {
+        auto bucket = static_cast<size_t>(std::max(duration.count(), 0.0) / BUCKET_WIDTH);
+        ++buckets[std::min(bucket, BUCKET_COUNT - 1)];
+        total += duration.count();
+        ++count;
+    }
+
+    void reset()
+    {
+        buckets.fill(0);
+        total = 0.0;
+        count = 0;
+    }
+
+    uint64_t samples() const
+    {
+        return count;
+    }
+
+    double mean() const
+    {
+        return count ? total / count : 0.0;
+    }
+
+    // Upper edge of the bucket containing the given percentile, in ms
+    double percentile(double p) const
+    {
+        auto target = static_cast<uint64_t>(p / 100.0 * count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += buckets[i];
+            if (seen > target)
+            {
+                return (i + 1) * BUCKET_WIDTH;
+            }
+        }
+        return BUCKET_COUNT * BUCKET_WIDTH;
+    }
+
+    void print(std::ostream &out, const char *name) const
+    {
+        out << std::fixed << std::setprecision(2)
+            << name << ": mean " << mean() << "ms"
+            << "  p50 " << percentile(50) << "ms"
+            << "  p95 " << percentile(95) << "ms"
+            << "  p99 " << percentile(99) << "ms"
+            << "  (" << count << " samples)\n";
+    }
+
+private:
+    static constexpr double BUCKET_WIDTH = 0.25;
+    static constexpr size_t BUCKET_COUNT = 1000;
+
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+    double total = 0.0;
+    uint64_t count = 0;
+};
+
+// Mean and worst of durations too short for DurationHistogram's buckets,
+// printed in microseconds
+class DurationSummary
+{
+public:
+    using Duration = std::chrono::duration<double, std::micro>;
+
+    void record(Duration duration)
+    {
+        total += duration.count();
+        worst = std::max(worst, duration.count());
+        ++count;
+    }
+
+    void reset()
+    {
+        total = 0.0;
+        worst = 0.0;
+        count = 0;
+    }
+
+    uint64_t samples() const
+    {
+        return count;
+    }
+
+    double mean() const
+    {
+        return count ? total / count : 0.0;
+    }
+
+    void print(std::ostream &out, const char *name) const
+    {
+        out << std::fixed << std::setprecision(2)
+            << name << ": mean " << mean() << "us"
+            << "  max " << worst << "us"
+            << "  (" << count << " samples)\n";
+    }
+
+private:
+    double total = 0.0;
+    double worst = 0.0;
+    uint64_t count = 0;
+};
+
+// Caps the frame rate by sleeping at the start of a frame rather than the
+// end, so input is sampled as late as possible. The sleep leaves room for
+// the expected CPU work of the frame, estimated from previous frames.
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // targetFrameRate of 0 leaves the frame rate uncapped
+    explicit FramePacer(double targetFrameRate)
+        : interval(targetFrameRate > 0.0
+                       ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFrameRate))
+                       : Clock::duration::zero())
+    {
+    }
+
+    // Call right before sampling input
+    void beginFrame()
+    {
+        auto now = Clock::now();
+
+        if (interval > Clock::duration::zero())
+        {
+            if (nextDeadline == Clock::time_point{} || now > nextDeadline)
+            {
+                // First frame or fell behind, don't try to catch up
+                nextDeadline = now + expectedWork;
+            }
+
+            auto wakeTime = nextDeadline - expectedWork - SLEEP_MARGIN;
+            if (wakeTime > now)
+            {
+                std::this_thread::sleep_until(wakeTime);
+                now = Clock::now();
+            }
+        }
+
+        frameStart = now;
+    }
+
+    // Call once the frame has been handed to the presentation engine
+    void endFrame()
+    {
+        auto now = Clock::now();
+
+        // Weight spikes up quickly and decay slowly to avoid missed deadlines
+        auto work = now - frameStart;
+        expectedWork = work > expectedWork ? work : (expectedWork * 15 + work) / 16;
+
+        if (lastFrameEnd != Clock::time_point{})
+        {
+            frameTimes.record(now - lastFrameEnd);
+        }
+        lastFrameEnd = now;
+
+        nextDeadline += interval;
+    }
+
+    DurationHistogram frameTimes;
+
+private:
+    static constexpr auto SLEEP_MARGIN = std::chrono::microseconds(500);
+
+    Clock::duration interval;
+    Clock::duration expectedWork = Clock::duration::zero();
+
+    Clock::time_point nextDeadline;
+    Clock::time_point frameStart;
+    Clock::time_point lastFrameEnd;
+};
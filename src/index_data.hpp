@@ -0,0 +1,82 @@
+#pragma once
+
+#define VULKAN_HPP_NO_CONSTRUCTORS
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// Indices stored in the smallest type that can address every vertex of the
+// mesh. Meshes are authored with 32-bit indices and compacted on upload
+struct IndexData
+{
+    std::vector<std::byte> bytes;
+    vk::IndexType type = vk::IndexType::eUint32;
+    uint32_t count = 0;
+
+    // uint8 needs the indexTypeUint8 feature
+    static vk::IndexType smallestType(std::span<const uint32_t> indices, bool allowUint8)
+    {
+        uint32_t largest = indices.empty() ? 0 : std::ranges::max(indices);
+        if (allowUint8 && largest <= UINT8_MAX)
+        {
+            return vk::IndexType::eUint8EXT;
+        }
+        return largest <= UINT16_MAX ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    }
+
+    static IndexData pack(std::span<const uint32_t> indices, bool allowUint8)
+    {
+        return pack(indices, smallestType(indices, allowUint8));
+    }
+
+    // Stores indices as type, which must be able to hold every one of them
+    static IndexData pack(std::span<const uint32_t> indices, vk::IndexType type)
+    {
+        IndexData data;
+        data.type = type;
+        data.count = static_cast<uint32_t>(indices.size());
+        switch (type)
+        {
+        case vk::IndexType::eUint8EXT:
+            data.store<uint8_t>(indices);
+            break;
+        case vk::IndexType::eUint16:
+            data.store<uint16_t>(indices);
+            break;
+        default:
+            data.store<uint32_t>(indices);
+        }
+        return data;
+    }
+
+    static size_t indexSize(vk::IndexType type)
+    {
+        switch (type)
+        {
+        case vk::IndexType::eUint8EXT:
+            return 1;
+        case vk::IndexType::eUint16:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+private:
+    template <typename T>
+    void store(std::span<const uint32_t> indices)
+    {
+        bytes.resize(indices.size() * sizeof(T));
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            T index = static_cast<T>(indices[i]);
+            std::memcpy(bytes.data() + i * sizeof(T), &index, sizeof(T));
+        }
+    }
+};
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class JobCounter;
+
+struct Job
+{
+    std::function<void()> task;
+    JobCounter *counter;
+};
+
+// Counts outstanding jobs. Jobs scheduled with a counter as their dependency
+// are held back until it drops to zero. A counter must be waited on with
+// JobSystem::wait before it is destroyed.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool isDone() const
+    {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending{0};
+
+    std::mutex continuationMutex;
+    std::vector<Job *> continuations;
+
+    // First exception thrown by a job, rethrown from JobSystem::wait
+    std::exception_ptr error;
+};
+
+// Chase-Lev deque (Le et al. 2013). Only the owning worker pushes and takes
+// from the bottom, any thread may steal from the top.
+class WorkStealingDeque
+{
+public:
+    static constexpr int64_t CAPACITY = 4096;
+
+    bool push(Job *job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+        {
+            return false;
+        }
+
+        buffer[b & MASK].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job *take()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = buffer[b & MASK].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // Last element, race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job *steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+            return nullptr;
+        }
+
+        Job *job = buffer[t & MASK].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return job;
+    }
+
+private:
+    static constexpr int64_t MASK = CAPACITY - 1;
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::array<std::atomic<Job *>, CAPACITY> buffer{};
+};
+
+class JobSystem
+{
+public:
+    explicit JobSystem(uint32_t workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1)
+    {
+        deques.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            deques.push_back(std::make_unique<WorkStealingDeque>());
+        }
+
+        workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back([this, i]
+                                 { workerLoop(i); });
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    uint32_t workerCount() const
+    {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    // Runs task on a worker. counter (if any) is incremented now and
+    // decremented once task has finished. If dependency is given the task
+    // only becomes runnable after dependency reaches zero.
+    void schedule(std::function<void()> task, JobCounter *counter = nullptr, JobCounter *dependency = nullptr)
+    {
+        if (counter)
+        {
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto job = new Job{std::move(task), counter};
+
+        if (dependency)
+        {
+            std::lock_guard lock(dependency->continuationMutex);
+            if (!dependency->isDone())
+            {
+                dependency->continuations.push_back(job);
+                return;
+            }
+        }
+
+        enqueue(job);
+    }
+
+    // Blocks until counter reaches zero, running other jobs in the meantime.
+    // Rethrows the first exception thrown by one of the counted jobs.
+    void wait(JobCounter &counter)
+    {
+        while (!counter.isDone())
+        {
+            if (auto job = findJob())
+            {
+                execute(job);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // Wait for the last job to leave the counter before it can go away
+        std::lock_guard lock(counter.continuationMutex);
+
+        if (counter.error)
+        {
+            std::rethrow_exception(std::exchange(counter.error, nullptr));
+        }
+    }
+
+    // Splits [0, count) into batches of batchSize and calls fn(begin, end)
+    // for each of them in parallel. Returns once every batch is done.
+    template <typename F>
+    void parallelFor(uint32_t count, uint32_t batchSize, F &&fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        batchSize = std::max(batchSize, 1u);
+        if (count <= batchSize)
+        {
+            fn(0u, count);
+            return;
+        }
+
+        JobCounter counter;
+        for (uint32_t begin = 0; begin < count; begin += batchSize)
+        {
+            uint32_t end = std::min(begin + batchSize, count);
+            schedule([&fn, begin, end]
+                     { fn(begin, end); },
+                     &counter);
+        }
+        wait(counter);
+    }
+
+private:
+    static inline thread_local int32_t workerIndex = -1;
+
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+    std::vector<std::thread> workers;
+
+    // Jobs pushed from threads that don't own a deque
+    std::mutex injectionMutex;
+    std::deque<Job *> injectionQueue;
+
+    std::atomic<uint32_t> queuedJobs{0};
+    std::atomic<uint32_t> sleepingWorkers{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool stopping = false;
+
+    void enqueue(Job *job)
+    {
+        queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+        if (workerIndex < 0 || !deques[workerIndex]->push(job))
+        {
+            std::lock_guard lock(injectionMutex);
+            injectionQueue.push_back(job);
+        }
+
+        if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+        {
+            // Taking the lock ensures the notify cannot slip in between a
+            // worker's predicate check and its wait
+            {
+                std::lock_guard lock(sleepMutex);
+            }
+            sleepCondition.notify_one();
+        }
+    }
+
+    Job *findJob()
+    {
+        Job *job = nullptr;
+
+        if (workerIndex >= 0)
+        {
+            job = deques[workerIndex]->take();
+        }
+
+        if (!job)
+        {
+            std::lock_guard lock(injectionMutex);
+            if (!injectionQueue.empty())
+            {
+                job = injectionQueue.front();
+                injectionQueue.pop_front();
+            }
+        }
+
+        if (!job && !deques.empty())
+        {
+            thread_local std::minstd_rand random{std::random_device{}()};
+            size_t start = random() % deques.size();
+            for (size_t i = 0; i < deques.size() && !job; ++i)
+            {
+                size_t victim = (start + i) % deques.size();
+                if (static_cast<int32_t>(victim) != workerIndex)
+                {
+                    job = deques[victim]->steal();
+                }
+            }
+        }
+
+        if (job)
+        {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    void execute(Job *job)
+    {
+        std::exception_ptr error;
+        if (job->counter)
+        {
+            try
+            {
+                job->task();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+        else
+        {
+            job->task();
+        }
+
+        if (auto counter = job->counter)
+        {
+            // The counter must not be touched once the lock is released, a
+            // waiter may destroy it right after
+            std::vector<Job *> continuations;
+            {
+                std::lock_guard lock(counter->continuationMutex);
+                if (error && !counter->error)
+                {
+                    counter->error = error;
+                }
+                if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    continuations.swap(counter->continuations);
+                }
+            }
+            for (auto continuation : continuations)
+            {
+                enqueue(continuation);
+            }
+        }
+
+        delete job;
+    }
+
+    void workerLoop(uint32_t index)
+    {
+        workerIndex = static_cast<int32_t>(index);
+
+        while (true)
+        {
+            if (auto job = findJob())
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock lock(sleepMutex);
+            sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+            sleepCondition.wait(lock, [this]
+                                { return stopping || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+            sleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+};
+
+// Thread pool around a single mutex protected queue, the baseline
+// Application::benchmarkJobSystem measures JobSystem against
+class MutexQueuePool
+{
+public:
+    explicit MutexQueuePool(uint32_t workerCount)
+    {
+        workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back([this]
+                                 { workerLoop(); });
+        }
+    }
+
+    MutexQueuePool(const MutexQueuePool &) = delete;
+    MutexQueuePool &operator=(const MutexQueuePool &) = delete;
+
+    ~MutexQueuePool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    void schedule(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            queue.push_back(std::move(task));
+            ++pending;
+        }
+        jobAvailable.notify_one();
+    }
+
+    // Blocks until every scheduled task, including ones scheduled by tasks,
+    // has finished
+    void waitIdle()
+    {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [this]
+                  { return pending == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> queue;
+    uint32_t pending = 0;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            jobAvailable.wait(lock, [this]
+                              { return stopping || !queue.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+
+            auto task = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+
+            if (--pending == 0)
+            {
+                idle.notify_all();
+            }
+        }
+    }
+};
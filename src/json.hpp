@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// Minimal JSON reader, enough for glTF. Numbers are doubles, \u escapes
+// outside ASCII are replaced with '?'
+class JsonValue
+{
+public:
+    using Array = std::vector<JsonValue>;
+    using Object = std::map<std::string, JsonValue, std::less<>>;
+
+    JsonValue() = default;
+
+    static JsonValue parse(std::string_view text)
+    {
+        Parser parser{text};
+        auto value = parser.parseValue();
+        parser.skipWhitespace();
+        if (parser.position != text.size())
+        {
+            throw std::runtime_error("Unexpected trailing characters in JSON!");
+        }
+        return value;
+    }
+
+    bool isNull() const
+    {
+        return std::holds_alternative<std::monostate>(value);
+    }
+
+    bool isObject() const
+    {
+        return std::holds_alternative<Object>(value);
+    }
+
+    bool isArray() const
+    {
+        return std::holds_alternative<Array>(value);
+    }
+
+    double number() const
+    {
+        return get<double>();
+    }
+
+    bool boolean() const
+    {
+        return get<bool>();
+    }
+
+    const std::string &string() const
+    {
+        return get<std::string>();
+    }
+
+    const Array &array() const
+    {
+        return get<Array>();
+    }
+
+    const Object &object() const
+    {
+        return get<Object>();
+    }
+
+    template <typename T>
+    T as() const
+    {
+        return static_cast<T>(number());
+    }
+
+    // Member lookup, a null value when missing or not an object
+    const JsonValue &operator[](std::string_view key) const
+    {
+        static const JsonValue null;
+        if (!isObject())
+        {
+            return null;
+        }
+        auto &members = object();
+        auto member = members.find(key);
+        return member == members.end() ? null : member->second;
+    }
+
+    const JsonValue &operator[](size_t index) const
+    {
+        return array().at(index);
+    }
+
+    bool contains(std::string_view key) const
+    {
+        return !(*this)[key].isNull();
+    }
+
+    template <typename T>
+    T valueOr(std::string_view key, T fallback) const
+    {
+        auto &member = (*this)[key];
+        return member.isNull() ? fallback : member.as<T>();
+    }
+
+private:
+    std::variant<std::monostate, bool, double, std::string, Array, Object> value;
+
+    template <typename T>
+    const T &get() const
+    {
+        if (auto result = std::get_if<T>(&value))
+        {
+            return *result;
+        }
+        throw std::runtime_error("Unexpected JSON value type!");
+    }
+
+    struct Parser
+    {
+        std::string_view text;
+        size_t position = 0;
+
+        void skipWhitespace()
+        {
+            while (position < text.size() && (text[position] == ' ' || text[position] == '\t' ||
+                                              text[position] == '\n' || text[position] == '\r'))
+            {
+                ++position;
+            }
+        }
+
+        char peek()
+        {
+            skipWhitespace();
+            if (position >= text.size())
+            {
+                throw std::runtime_error("Unexpected end of JSON!");
+            }
+            return text[position];
+        }
+
+        void expect(char c)
+        {
+            if (peek() != c)
+            {
+                throw std::runtime_error(std::string("Expected '") + c + "' in JSON!");
+            }
+            ++position;
+        }
+
+        bool consume(std::string_view literal)
+        {
+            if (text.substr(position, literal.size()) == literal)
+            {
+                position += literal.size();
+                return true;
+            }
+            return false;
+        }
+
+        JsonValue parseValue()
+        {
+            JsonValue result;
+            char c = peek();
+            if (c == '{')
+            {
+                result.value = parseObject();
+            }
+            else if (c == '[')
+            {
+                result.value = parseArray();
+            }
+            else if (c == '"')
+            {
+                result.value = parseString();
+            }
+            else if (consume("true"))
+            {
+                result.value = true;
+            }
+            else if (consume("false"))
+            {
+                result.value = false;
+            }
+            else if (consume("null"))
+            {
+            }
+            else
+            {
+                result.value = parseNumber();
+            }
+            return result;
+        }
+
+        Object parseObject()
+        {
+            Object members;
+            expect('{');
+            if (peek() == '}')
+            {
+                ++position;
+                return members;
+            }
+            while (true)
+            {
+                peek();
+                auto key = parseString();
+                expect(':');
+                members.insert_or_assign(std::move(key), parseValue());
+                if (peek() == ',')
+                {
+                    ++position;
+                    continue;
+                }
+                expect('}');
+                return members;
+            }
+        }
+
+        Array parseArray()
+        {
+            Array elements;
+            expect('[');
+            if (peek() == ']')
+            {
+                ++position;
+                return elements;
+            }
+            while (true)
+            {
+                elements.push_back(parseValue());
+                if (peek() == ',')
+                {
+                    ++position;
+                    continue;
+                }
+                expect(']');
+                return elements;
+            }
+        }
+
+        std::string parseString()
+        {
+            expect('"');
+            std::string result;
+            while (position < text.size() && text[position] != '"')
+            {
+                char c = text[position++];
+                if (c != '\\')
+                {
+                    result += c;
+                    continue;
+                }
+                if (position >= text.size())
+                {
+                    break;
+                }
+
+                char escaped = text[position++];
+                switch (escaped)
+                {
+                case 'b':
+                    result += '\b';
+                    break;
+                case 'f':
+                    result += '\f';
+                    break;
+                case 'n':
+                    result += '\n';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'u':
+                {
+                    auto code = std::strtoul(std::string(text.substr(position, 4)).c_str(), nullptr, 16);
+                    result += code < 0x80 ? static_cast<char>(code) : '?';
+                    position += 4;
+                    break;
+                }
+                default:
+                    result += escaped;
+                }
+            }
+            expect('"');
+            return result;
+        }
+
+        double parseNumber()
+        {
+            size_t start = position;
+            while (position < text.size() && (std::isdigit(static_cast<unsigned char>(text[position])) ||
+                                              text[position] == '-' || text[position] == '+' ||
+                                              text[position] == '.' || text[position] == 'e' || text[position] == 'E'))
+            {
+                ++position;
+            }
+            if (start == position)
+            {
+                throw std::runtime_error("Unexpected character in JSON!");
+            }
+
+            std::string number(text.substr(start, position - start));
+            char *end = nullptr;
+            double result = std::strtod(number.c_str(), &end);
+            if (end != number.c_str() + number.size())
+            {
+                throw std::runtime_error("Malformed number in JSON!");
+            }
+            return result;
+        }
+    };
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Read-only memory mapping of a whole file. Pages are faulted in on first
+// access, so reading is bounded by the disk rather than by copies
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string &path)
+    {
+        int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0)
+        {
+            throw std::runtime_error("Failed to open " + path + "!");
+        }
+
+        struct stat status{};
+        if (::fstat(descriptor, &status) != 0)
+        {
+            ::close(descriptor);
+            throw std::runtime_error("Failed to stat " + path + "!");
+        }
+
+        fileSize = static_cast<size_t>(status.st_size);
+        if (fileSize > 0)
+        {
+            void *mapping = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping == MAP_FAILED)
+            {
+                ::close(descriptor);
+                throw std::runtime_error("Failed to map " + path + "!");
+            }
+            mapped = static_cast<const std::byte *>(mapping);
+        }
+
+        // The mapping keeps the file alive on its own
+        ::close(descriptor);
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+        : mapped(std::exchange(other.mapped, nullptr)), fileSize(std::exchange(other.fileSize, 0))
+    {
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        std::swap(mapped, other.mapped);
+        std::swap(fileSize, other.fileSize);
+        return *this;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (mapped)
+        {
+            ::munmap(const_cast<std::byte *>(mapped), fileSize);
+        }
+    }
+
+    const std::byte *data() const
+    {
+        return mapped;
+    }
+
+    size_t size() const
+    {
+        return fileSize;
+    }
+
+    std::string_view text() const
+    {
+        return {reinterpret_cast<const char *>(mapped), fileSize};
+    }
+
+private:
+    const std::byte *mapped = nullptr;
+    size_t fileSize = 0;
+};
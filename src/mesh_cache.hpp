@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "mesh_import.hpp"
+
+// Binary cache of imported and optimized meshes, so later runs skip parsing
+// and optimization. A cache file is a header followed by the vertex, index
+// and level of detail arrays, each aligned for direct copies:
+//
+//   MeshCacheHeader | pad | Vertex[vertexCount] | pad | uint32_t[indexCount]
+//   | pad | MeshLod[lodCount]
+//
+// Files are named after the hash of the source file's contents, so an edited
+// source gets a new entry. Bump MESH_CACHE_VERSION whenever Vertex or the
+// import steps change, older files are then ignored. Settings of the import
+// steps are stored in the header and must match as well
+const uint32_t MESH_CACHE_VERSION = 3;
+const size_t MESH_CACHE_ALIGNMENT = 64;
+
+// Import settings the cached data depends on
+struct MeshCacheSettings
+{
+    // Level of detail generation, maxLods is 0 when it is off
+    uint32_t maxLods = 0;
+    float maxLodError = 0.0f;
+
+    bool operator==(const MeshCacheSettings &) const = default;
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    MeshCacheSettings settings;
+    uint32_t vertexSize;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t lodOffset;
+};
+
+inline constexpr char MESH_CACHE_MAGIC[4] = {'X', 'T', 'M', 'C'};
+
+// 64-bit FNV-1a over 8-byte words, fast enough to stay disk bound
+inline uint64_t hashBytes(std::span<const std::byte> bytes)
+{
+    constexpr uint64_t PRIME = 0x100000001b3;
+    uint64_t hash = 0xcbf29ce484222325;
+
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = (hash ^ word) * PRIME;
+    }
+    for (; i < bytes.size(); ++i)
+    {
+        hash = (hash ^ static_cast<uint64_t>(bytes[i])) * PRIME;
+    }
+    return hash;
+}
+
+inline std::filesystem::path meshCachePath(const std::filesystem::path &directory, uint64_t sourceHash)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(sourceHash));
+    return directory / name;
+}
+
+inline uint64_t alignCacheOffset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+// Empty when the file is missing, from another version or doesn't match the
+// source or settings. Truncated or inconsistent files are treated as missing
+// too
+inline std::optional<MeshData> loadMeshCache(const std::filesystem::path &path, uint64_t sourceHash,
+                                             const MeshCacheSettings &settings)
+{
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(path, error))
+    {
+        return std::nullopt;
+    }
+
+    MappedFile file(path.string());
+    MeshCacheHeader header;
+    if (file.size() < sizeof(header))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    uint64_t vertexBytes = uint64_t(header.vertexCount) * sizeof(Vertex);
+    uint64_t indexBytes = uint64_t(header.indexCount) * sizeof(uint32_t);
+    uint64_t lodBytes = uint64_t(header.lodCount) * sizeof(MeshLod);
+
+    // Written so that offsets read from the file can't wrap around
+    auto fits = [&](uint64_t offset, uint64_t bytes)
+    {
+        return offset <= file.size() && bytes <= file.size() - offset;
+    };
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MESH_CACHE_VERSION || header.sourceHash != sourceHash || header.settings != settings ||
+        header.vertexSize != sizeof(Vertex) ||
+        !fits(header.vertexOffset, vertexBytes) || !fits(header.indexOffset, indexBytes) || !fits(header.lodOffset, lodBytes) ||
+        header.vertexOffset < sizeof(header) || header.indexOffset < header.vertexOffset + vertexBytes ||
+        header.lodOffset < header.indexOffset + indexBytes)
+    {
+        return std::nullopt;
+    }
+
+    MeshData mesh;
+    mesh.vertices.resize(header.vertexCount);
+    mesh.indices.resize(header.indexCount);
+    mesh.lods.resize(header.lodCount);
+    auto copyBlob = [&](void *destination, uint64_t offset, uint64_t size)
+    {
+        if (size > 0)
+        {
+            std::memcpy(destination, file.data() + offset, size);
+        }
+    };
+    copyBlob(mesh.vertices.data(), header.vertexOffset, vertexBytes);
+    copyBlob(mesh.indices.data(), header.indexOffset, indexBytes);
+    copyBlob(mesh.lods.data(), header.lodOffset, lodBytes);
+
+    // Levels become indirect draws, they must stay inside the index array
+    for (auto &lod : mesh.lods)
+    {
+        if (uint64_t(lod.firstIndex) + lod.indexCount > header.indexCount)
+        {
+            return std::nullopt;
+        }
+    }
+    return mesh;
+}
+
+// Writes to a temporary file and renames it into place, so a concurrent or
+// interrupted run never sees a partial cache file. Throws when the directory
+// or file can't be written, a failed temporary file is removed
+inline void writeMeshCache(const std::filesystem::path &path, uint64_t sourceHash, const MeshCacheSettings &settings,
+                           const MeshData &mesh)
+{
+    MeshCacheHeader header{
+        .version = MESH_CACHE_VERSION,
+        .sourceHash = sourceHash,
+        .settings = settings,
+        .vertexSize = sizeof(Vertex),
+        .vertexCount = static_cast<uint32_t>(mesh.vertices.size()),
+        .indexCount = static_cast<uint32_t>(mesh.indices.size()),
+        .lodCount = static_cast<uint32_t>(mesh.lods.size()),
+    };
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.vertexOffset = alignCacheOffset(sizeof(header));
+    header.indexOffset = alignCacheOffset(header.vertexOffset + mesh.vertices.size() * sizeof(Vertex));
+    header.lodOffset = alignCacheOffset(header.indexOffset + mesh.indices.size() * sizeof(uint32_t));
+
+    std::filesystem::create_directories(path.parent_path());
+    auto temporaryPath = path;
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to create mesh cache " + temporaryPath.string() + "!");
+        }
+
+        const char padding[MESH_CACHE_ALIGNMENT]{};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(padding, header.vertexOffset - sizeof(header));
+        file.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+        file.write(padding, header.indexOffset - header.vertexOffset - mesh.vertices.size() * sizeof(Vertex));
+        file.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+        file.write(padding, header.lodOffset - header.indexOffset - mesh.indices.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char *>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshLod));
+        if (!file)
+        {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(temporaryPath, error);
+            throw std::runtime_error("Failed to write mesh cache " + temporaryPath.string() + "!");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
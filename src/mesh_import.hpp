@@ -0,0 +1,453 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+#include "mapped_file.hpp"
+#include "vertex_formats.hpp"
+
+// One level of detail, a range of MeshData::indices
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+
+    // Largest distance from the full detail surface, in mesh units
+    float error;
+};
+
+// Indexed triangle list in the authoring vertex layout. Levels of detail
+// share the vertices and append their indices, no levels means the indices
+// are a single full detail level
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+};
+
+// Neither format is required to carry colors, shade by the normal instead
+// or fall back to a flat grey
+inline glm::vec3 colorFromNormal(glm::vec3 normal)
+{
+    return glm::abs(normal);
+}
+
+inline const glm::vec3 DEFAULT_MESH_COLOR{0.8f};
+
+// Wavefront OBJ: v (with the common "v x y z r g b" color extension), vn and
+// f with any of the v, v/vt, v//vn and v/vt/vn forms. Polygons are fanned,
+// every other statement is ignored. Vertices are emitted per face corner and
+// left for deduplicateVertices to merge
+inline MeshData loadObj(std::string_view text)
+{
+    std::vector<glm::vec3> positions, colors, normals;
+    bool hasColors = false;
+    MeshData mesh;
+
+    auto nextToken = [](std::string_view &line)
+    {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+        {
+            line = {};
+            return std::string_view{};
+        }
+        size_t end = line.find_first_of(" \t\r", start);
+        auto token = line.substr(start, end - start);
+        line = end == std::string_view::npos ? std::string_view{} : line.substr(end);
+        return token;
+    };
+
+    auto parseFloats = [&](std::string_view &line, float *values, int count)
+    {
+        int parsed = 0;
+        for (; parsed < count; ++parsed)
+        {
+            auto token = nextToken(line);
+            if (token.empty() || std::from_chars(token.data(), token.data() + token.size(), values[parsed]).ec != std::errc{})
+            {
+                break;
+            }
+        }
+        return parsed;
+    };
+
+    // OBJ indices are 1-based, negative ones count back from the latest element
+    auto resolve = [](std::string_view token, size_t size) -> int64_t
+    {
+        int64_t index = 0;
+        if (token.empty() || std::from_chars(token.data(), token.data() + token.size(), index).ec != std::errc{})
+        {
+            return -1;
+        }
+        index = index < 0 ? static_cast<int64_t>(size) + index : index - 1;
+        return index < static_cast<int64_t>(size) ? index : -1;
+    };
+
+    auto faceVertex = [&](std::string_view token)
+    {
+        size_t firstSlash = token.find('/');
+        auto position = resolve(token.substr(0, firstSlash), positions.size());
+        if (position < 0)
+        {
+            throw std::runtime_error("Invalid position index in OBJ face!");
+        }
+
+        int64_t normal = -1;
+        if (firstSlash != std::string_view::npos)
+        {
+            size_t secondSlash = token.find('/', firstSlash + 1);
+            if (secondSlash != std::string_view::npos)
+            {
+                normal = resolve(token.substr(secondSlash + 1), normals.size());
+            }
+        }
+
+        glm::vec3 color = hasColors  ? colors[position]
+                          : normal >= 0 ? colorFromNormal(normals[normal])
+                                        : DEFAULT_MESH_COLOR;
+        mesh.vertices.push_back({positions[position], color});
+        return static_cast<uint32_t>(mesh.vertices.size() - 1);
+    };
+
+    size_t lineStart = 0;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        auto line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+
+        auto keyword = nextToken(line);
+        if (keyword == "v")
+        {
+            float values[6]{};
+            int count = parseFloats(line, values, 6);
+            if (count < 3)
+            {
+                throw std::runtime_error("Malformed OBJ vertex!");
+            }
+            positions.emplace_back(values[0], values[1], values[2]);
+            colors.push_back(count == 6 ? glm::vec3(values[3], values[4], values[5]) : DEFAULT_MESH_COLOR);
+            hasColors |= count == 6;
+        }
+        else if (keyword == "vn")
+        {
+            float values[3]{};
+            parseFloats(line, values, 3);
+            normals.push_back(glm::normalize(glm::vec3(values[0], values[1], values[2])));
+        }
+        else if (keyword == "f")
+        {
+            std::vector<uint32_t> polygon;
+            for (auto token = nextToken(line); !token.empty(); token = nextToken(line))
+            {
+                polygon.push_back(faceVertex(token));
+            }
+            for (size_t i = 2; i < polygon.size(); ++i)
+            {
+                mesh.indices.insert(mesh.indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+            }
+        }
+    }
+
+    return mesh;
+}
+
+// glTF 2.0 binary container. Every triangle list primitive of every mesh is
+// merged into one mesh in its local space, node transforms aren't applied
+class GlbReader
+{
+public:
+    static MeshData load(std::string_view data)
+    {
+        GlbReader reader(data);
+        return reader.readMeshes();
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x46546C67; // "glTF"
+    static constexpr uint32_t CHUNK_JSON = 0x4E4F534A;
+    static constexpr uint32_t CHUNK_BIN = 0x004E4942;
+
+    static constexpr int COMPONENT_UNSIGNED_BYTE = 5121;
+    static constexpr int COMPONENT_UNSIGNED_SHORT = 5123;
+    static constexpr int COMPONENT_UNSIGNED_INT = 5125;
+    static constexpr int COMPONENT_FLOAT = 5126;
+    static constexpr int MODE_TRIANGLES = 4;
+
+    JsonValue document;
+    std::string_view binary;
+
+    explicit GlbReader(std::string_view data)
+    {
+        if (data.size() < 20 || read<uint32_t>(data, 0) != MAGIC || read<uint32_t>(data, 4) != 2)
+        {
+            throw std::runtime_error("Not a glTF 2.0 binary file!");
+        }
+
+        size_t offset = 12;
+        while (offset + 8 <= data.size())
+        {
+            auto length = read<uint32_t>(data, offset);
+            auto type = read<uint32_t>(data, offset + 4);
+            if (offset + 8 + length > data.size())
+            {
+                throw std::runtime_error("Truncated glTF chunk!");
+            }
+
+            auto chunk = data.substr(offset + 8, length);
+            if (type == CHUNK_JSON)
+            {
+                document = JsonValue::parse(chunk);
+            }
+            else if (type == CHUNK_BIN && binary.empty())
+            {
+                binary = chunk;
+            }
+            offset += 8 + (length + 3) / 4 * 4;
+        }
+
+        if (!document.isObject())
+        {
+            throw std::runtime_error("glTF file has no JSON chunk!");
+        }
+    }
+
+    template <typename T>
+    static T read(std::string_view data, size_t offset)
+    {
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        return value;
+    }
+
+    static int componentCount(const std::string &type)
+    {
+        if (type == "SCALAR")
+        {
+            return 1;
+        }
+        if (type == "VEC2")
+        {
+            return 2;
+        }
+        if (type == "VEC3")
+        {
+            return 3;
+        }
+        if (type == "VEC4")
+        {
+            return 4;
+        }
+        throw std::runtime_error("Unsupported glTF accessor type " + type + "!");
+    }
+
+    // Accessor elements converted to floats, normalized integers are mapped to
+    // [0, 1] and the rest converted as is. Only the first `components` values
+    // of each element are kept, missing ones are zero
+    std::vector<float> readAccessor(size_t accessorIndex, int components) const
+    {
+        auto &accessor = document["accessors"][accessorIndex];
+        if (accessor.contains("sparse"))
+        {
+            throw std::runtime_error("Sparse glTF accessors aren't supported!");
+        }
+
+        auto count = accessor["count"].as<size_t>();
+        auto componentType = accessor["componentType"].as<int>();
+        int elementComponents = componentCount(accessor["type"].string());
+        bool normalized = accessor.contains("normalized") && accessor["normalized"].boolean();
+
+        size_t componentSize = componentType == COMPONENT_UNSIGNED_BYTE    ? 1
+                               : componentType == COMPONENT_UNSIGNED_SHORT ? 2
+                               : componentType == COMPONENT_UNSIGNED_INT || componentType == COMPONENT_FLOAT
+                                   ? 4
+                                   : 0;
+        if (componentSize == 0)
+        {
+            throw std::runtime_error("Unsupported glTF component type!");
+        }
+
+        std::vector<float> values(count * components, 0.0f);
+        if (!accessor.contains("bufferView"))
+        {
+            return values;
+        }
+
+        auto &view = document["bufferViews"][accessor["bufferView"].as<size_t>()];
+        if (view.valueOr<size_t>("buffer", 0) != 0)
+        {
+            throw std::runtime_error("Only the GLB binary buffer is supported!");
+        }
+
+        size_t elementSize = componentSize * elementComponents;
+        size_t stride = view.valueOr<size_t>("byteStride", elementSize);
+        size_t start = view.valueOr<size_t>("byteOffset", 0) + accessor.valueOr<size_t>("byteOffset", 0);
+        if (count > 0 && start + (count - 1) * stride + elementSize > binary.size())
+        {
+            throw std::runtime_error("glTF accessor is out of the binary chunk!");
+        }
+
+        int copied = std::min(components, elementComponents);
+        for (size_t element = 0; element < count; ++element)
+        {
+            for (int component = 0; component < copied; ++component)
+            {
+                size_t offset = start + element * stride + component * componentSize;
+                float value = 0.0f;
+                switch (componentType)
+                {
+                case COMPONENT_UNSIGNED_BYTE:
+                    value = read<uint8_t>(binary, offset) / (normalized ? 255.0f : 1.0f);
+                    break;
+                case COMPONENT_UNSIGNED_SHORT:
+                    value = read<uint16_t>(binary, offset) / (normalized ? 65535.0f : 1.0f);
+                    break;
+                case COMPONENT_UNSIGNED_INT:
+                    value = static_cast<float>(read<uint32_t>(binary, offset));
+                    break;
+                default:
+                    value = read<float>(binary, offset);
+                }
+                values[element * components + component] = value;
+            }
+        }
+        return values;
+    }
+
+    // Indices are read separately so 32-bit values don't round through float
+    std::vector<uint32_t> readIndices(size_t accessorIndex) const
+    {
+        auto &accessor = document["accessors"][accessorIndex];
+        auto count = accessor["count"].as<size_t>();
+        auto componentType = accessor["componentType"].as<int>();
+        if (componentType == COMPONENT_FLOAT)
+        {
+            return {};
+        }
+
+        auto &view = document["bufferViews"][accessor["bufferView"].as<size_t>()];
+        size_t size = componentType == COMPONENT_UNSIGNED_BYTE ? 1 : componentType == COMPONENT_UNSIGNED_SHORT ? 2 : 4;
+        size_t start = view.valueOr<size_t>("byteOffset", 0) + accessor.valueOr<size_t>("byteOffset", 0);
+        if (start + count * size > binary.size())
+        {
+            throw std::runtime_error("glTF index accessor is out of the binary chunk!");
+        }
+
+        std::vector<uint32_t> indices(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t offset = start + i * size;
+            indices[i] = size == 1   ? read<uint8_t>(binary, offset)
+                         : size == 2 ? read<uint16_t>(binary, offset)
+                                     : read<uint32_t>(binary, offset);
+        }
+        return indices;
+    }
+
+    MeshData readMeshes() const
+    {
+        MeshData mesh;
+        if (!document.contains("meshes"))
+        {
+            return mesh;
+        }
+
+        for (auto &gltfMesh : document["meshes"].array())
+        {
+            for (auto &primitive : gltfMesh["primitives"].array())
+            {
+                auto &attributes = primitive["attributes"];
+                if (primitive.valueOr<int>("mode", MODE_TRIANGLES) != MODE_TRIANGLES || !attributes.contains("POSITION"))
+                {
+                    continue;
+                }
+
+                auto positions = readAccessor(attributes["POSITION"].as<size_t>(), 3);
+                size_t vertexCount = positions.size() / 3;
+
+                std::vector<float> colors, normals;
+                if (attributes.contains("COLOR_0"))
+                {
+                    colors = readAccessor(attributes["COLOR_0"].as<size_t>(), 3);
+                }
+                else if (attributes.contains("NORMAL"))
+                {
+                    normals = readAccessor(attributes["NORMAL"].as<size_t>(), 3);
+                }
+
+                auto baseVertex = static_cast<uint32_t>(mesh.vertices.size());
+                for (size_t i = 0; i < vertexCount; ++i)
+                {
+                    glm::vec3 position(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+                    glm::vec3 color = !colors.empty()    ? glm::vec3(colors[i * 3], colors[i * 3 + 1], colors[i * 3 + 2])
+                                      : !normals.empty() ? colorFromNormal(glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]))
+                                                         : DEFAULT_MESH_COLOR;
+                    mesh.vertices.push_back({position, color});
+                }
+
+                std::vector<uint32_t> indices;
+                if (primitive.contains("indices"))
+                {
+                    indices = readIndices(primitive["indices"].as<size_t>());
+                }
+                else
+                {
+                    indices.resize(vertexCount);
+                    for (uint32_t i = 0; i < vertexCount; ++i)
+                    {
+                        indices[i] = i;
+                    }
+                }
+
+                for (size_t i = 0; i + 2 < indices.size(); i += 3)
+                {
+                    if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount)
+                    {
+                        throw std::runtime_error("glTF index is out of range!");
+                    }
+                    mesh.indices.insert(mesh.indices.end(), {baseVertex + indices[i], baseVertex + indices[i + 1], baseVertex + indices[i + 2]});
+                }
+            }
+        }
+
+        return mesh;
+    }
+};
+
+// Parses the contents of an .obj or .glb file, picked by the path's extension
+inline MeshData importMesh(const std::string &path, std::string_view contents)
+{
+    auto extension = path.substr(path.find_last_of('.') + 1);
+    for (auto &c : extension)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    if (extension == "obj")
+    {
+        return loadObj(contents);
+    }
+    if (extension == "glb")
+    {
+        return GlbReader::load(contents);
+    }
+    throw std::runtime_error("Unsupported mesh format " + path + "!");
+}
+
+inline MeshData importMesh(const std::string &path)
+{
+    MappedFile file(path);
+    return importMesh(path, file.text());
+}
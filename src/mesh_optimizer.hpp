@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Index buffer and vertex order optimizations for indexed triangle lists.
+// Vertices are compared and hashed bytewise, so they must not have padding.
+
+template <typename V>
+struct VertexBytesHash
+{
+    size_t operator()(const V &vertex) const
+    {
+        return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char *>(&vertex), sizeof(V)));
+    }
+};
+
+template <typename V>
+struct VertexBytesEqual
+{
+    bool operator()(const V &a, const V &b) const
+    {
+        return std::memcmp(&a, &b, sizeof(V)) == 0;
+    }
+};
+
+// Merges bitwise identical vertices and rewrites indices to match, keeping
+// the order in which vertices are first referenced
+template <typename V>
+void deduplicateVertices(std::vector<V> &vertices, std::vector<uint32_t> &indices)
+{
+    static_assert(std::is_trivially_copyable_v<V>, "Vertices are compared bytewise");
+
+    std::unordered_map<V, uint32_t, VertexBytesHash<V>, VertexBytesEqual<V>> unique;
+    unique.reserve(vertices.size());
+
+    std::vector<V> result;
+    result.reserve(vertices.size());
+    for (auto &index : indices)
+    {
+        auto [entry, inserted] = unique.try_emplace(vertices[index], static_cast<uint32_t>(result.size()));
+        if (inserted)
+        {
+            result.push_back(vertices[index]);
+        }
+        index = entry->second;
+    }
+
+    vertices = std::move(result);
+}
+
+// Average cache miss ratio: transformed vertices per triangle with a FIFO
+// post-transform cache of cacheSize entries. 0.5 is the ideal for large
+// regular meshes, 3 means no reuse at all
+inline float averageCacheMissRatio(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = 16)
+{
+    if (indices.size() < 3)
+    {
+        return 0.0f;
+    }
+
+    // Timestamp of insertion per vertex, a vertex is cached while it is one
+    // of the last cacheSize inserted
+    std::vector<uint64_t> insertedAt(vertexCount, 0);
+    uint64_t time = cacheSize + 1;
+    uint64_t misses = 0;
+
+    for (auto index : indices)
+    {
+        if (time - insertedAt[index] > cacheSize)
+        {
+            insertedAt[index] = time++;
+            ++misses;
+        }
+    }
+
+    return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+// Reorders triangles for the post-transform vertex cache with Tom Forsyth's
+// linear-speed algorithm: repeatedly emit the best scoring triangle, favoring
+// vertices recently used and those with few triangles left. When nothing in
+// the cache has triangles left, restart from the most recently used vertex
+// that does (dead-end stack, as in Tipsify), else the first unemitted
+// triangle, so disconnected triangles stay linear
+inline void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+    constexpr int CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = -0.5f;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles using each vertex, packed into one array
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for (auto index : indices)
+    {
+        ++triangleOffsets[index + 1];
+    }
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        triangleOffsets[i + 1] += triangleOffsets[i];
+    }
+
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            auto vertex = indices[triangle * 3 + corner];
+            vertexTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]++] = triangle;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    auto vertexScore = [&](uint32_t vertex)
+    {
+        if (remainingTriangles[vertex] == 0)
+        {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        int position = cachePosition[vertex];
+        if (position >= 0)
+        {
+            // The last triangle's vertices get a fixed score so that the
+            // next triangle doesn't just reuse them in a strip
+            score = position < 3 ? LAST_TRIANGLE_SCORE
+                                 : std::pow(1.0f - (position - 3) / float(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+
+        return score + VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles[vertex]), VALENCE_BOOST_POWER);
+    };
+
+    std::vector<float> scores(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        scores[vertex] = vertexScore(vertex);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        triangleScores[triangle] = scores[indices[triangle * 3]] + scores[indices[triangle * 3 + 1]] + scores[indices[triangle * 3 + 2]];
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    // One extra slot for the vertices pushed out of the cache each step
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+
+    // Emitted vertices, every entry is popped at most once
+    std::vector<uint32_t> deadEnd;
+    deadEnd.reserve(indices.size());
+
+    size_t scanPosition = 0;
+    int64_t bestTriangle = -1;
+    while (result.size() < indices.size())
+    {
+        // Nothing adjacent to the cache
+        while (bestTriangle < 0 && !deadEnd.empty())
+        {
+            auto vertex = deadEnd.back();
+            deadEnd.pop_back();
+            float bestScore = -1.0f;
+            for (uint32_t i = 0; i < remainingTriangles[vertex]; ++i)
+            {
+                auto candidate = vertexTriangles[triangleOffsets[vertex] + i];
+                if (triangleScores[candidate] > bestScore)
+                {
+                    bestScore = triangleScores[candidate];
+                    bestTriangle = candidate;
+                }
+            }
+        }
+        if (bestTriangle < 0)
+        {
+            while (emitted[scanPosition])
+            {
+                ++scanPosition;
+            }
+            bestTriangle = static_cast<int64_t>(scanPosition);
+        }
+
+        auto triangle = static_cast<uint32_t>(bestTriangle);
+        emitted[triangle] = true;
+
+        // Emit, remove from the vertices' lists and move them to the front
+        nextCache.clear();
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            auto vertex = indices[triangle * 3 + corner];
+            result.push_back(vertex);
+
+            auto begin = vertexTriangles.begin() + triangleOffsets[vertex];
+            auto end = begin + remainingTriangles[vertex];
+            std::iter_swap(std::find(begin, end, triangle), end - 1);
+            --remainingTriangles[vertex];
+
+            nextCache.push_back(vertex);
+            deadEnd.push_back(vertex);
+        }
+        for (auto vertex : cache)
+        {
+            if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+            {
+                nextCache.push_back(vertex);
+            }
+        }
+        std::swap(cache, nextCache);
+
+        for (size_t position = 0; position < cache.size(); ++position)
+        {
+            cachePosition[cache[position]] = position < CACHE_SIZE ? static_cast<int>(position) : -1;
+        }
+
+        // Rescore the touched vertices and their triangles, picking the
+        // next triangle among those
+        float bestScore = -1.0f;
+        bestTriangle = -1;
+        for (auto vertex : cache)
+        {
+            scores[vertex] = vertexScore(vertex);
+        }
+        for (auto vertex : cache)
+        {
+            for (uint32_t i = 0; i < remainingTriangles[vertex]; ++i)
+            {
+                auto neighbour = vertexTriangles[triangleOffsets[vertex] + i];
+                float score = scores[indices[neighbour * 3]] + scores[indices[neighbour * 3 + 1]] + scores[indices[neighbour * 3 + 2]];
+                triangleScores[neighbour] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = neighbour;
+                }
+            }
+        }
+
+        if (cache.size() > CACHE_SIZE)
+        {
+            cache.resize(CACHE_SIZE);
+        }
+    }
+
+    indices = std::move(result);
+}
+
+// Reorders vertices by first use in the index buffer so vertex fetches walk
+// memory mostly forward
+template <typename V>
+void optimizeVertexFetch(std::vector<V> &vertices, std::vector<uint32_t> &indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<V> result;
+    result.reserve(vertices.size());
+
+    for (auto &index : indices)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    // Unreferenced vertices are dropped
+    vertices = std::move(result);
+}
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_import.hpp"
+#include "mesh_optimizer.hpp"
+
+// Quadric error metric simplification (Garland & Heckbert). Edges are
+// collapsed cheapest first onto one of their endpoints, so every level of
+// detail indexes the original vertices and can share their buffer range
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct Quadric
+{
+    // a², ab, ac, ad, b², bc, bd, c², cd, d²
+    std::array<double, 10> m{};
+
+    static Quadric fromPlane(glm::dvec3 normal, double distance, double weight)
+    {
+        auto [a, b, c] = std::array{normal.x, normal.y, normal.z};
+        double d = distance;
+        return {{a * a * weight, a * b * weight, a * c * weight, a * d * weight,
+                 b * b * weight, b * c * weight, b * d * weight,
+                 c * c * weight, c * d * weight,
+                 d * d * weight}};
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    {
+        for (size_t i = 0; i < m.size(); ++i)
+        {
+            m[i] += other.m[i];
+        }
+        return *this;
+    }
+
+    // Weighted sum of squared distances from p to the planes
+    double evaluate(glm::dvec3 p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+                       m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+                       m[7] * z * z + 2 * m[8] * z +
+                       m[9];
+        return std::max(error, 0.0);
+    }
+};
+
+// Reduces the triangle list to at most targetIndexCount indices, stopping
+// early when the next collapse would move the surface by more than maxError.
+// Returns indices into the original vertices, error receives the largest
+// distance of the simplified surface from the original. Vertices sharing a
+// position are welded so color seams don't block collapses
+inline std::vector<uint32_t> simplifyMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                          size_t targetIndexCount, float maxError, float *error = nullptr)
+{
+    // Open edges are kept in place by planes through them perpendicular to
+    // their triangle, weighted well above the surface planes
+    constexpr double BORDER_WEIGHT = 10.0;
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3 &p) const
+        {
+            return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char *>(&p), sizeof(p)));
+        }
+    };
+
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> welded;
+    std::vector<uint32_t> weldedIds(vertices.size());
+    std::vector<uint32_t> representative;
+    std::vector<glm::dvec3> positions;
+    for (uint32_t i = 0; i < vertices.size(); ++i)
+    {
+        auto [entry, inserted] = welded.try_emplace(vertices[i].pos, static_cast<uint32_t>(positions.size()));
+        if (inserted)
+        {
+            representative.push_back(i);
+            positions.push_back(vertices[i].pos);
+        }
+        weldedIds[i] = entry->second;
+    }
+
+    size_t vertexCount = positions.size();
+    std::vector<std::array<uint32_t, 3>> triangles;
+    triangles.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        std::array<uint32_t, 3> triangle{weldedIds[indices[i]], weldedIds[indices[i + 1]], weldedIds[indices[i + 2]]};
+        if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2])
+        {
+            triangles.push_back(triangle);
+        }
+    }
+
+    auto triangleNormal = [&](const std::array<uint32_t, 3> &triangle)
+    {
+        return glm::cross(positions[triangle[1]] - positions[triangle[0]], positions[triangle[2]] - positions[triangle[0]]);
+    };
+
+    // Quadrics, triangle adjacency and open edges
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    std::unordered_map<uint64_t, int> edgeUses;
+    auto edgeKey = [](uint32_t a, uint32_t b)
+    {
+        return uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+    };
+
+    for (uint32_t t = 0; t < triangles.size(); ++t)
+    {
+        auto &triangle = triangles[t];
+        auto normal = triangleNormal(triangle);
+        double length = glm::length(normal);
+        if (length > 0.0)
+        {
+            normal /= length;
+            auto plane = Quadric::fromPlane(normal, -glm::dot(normal, positions[triangle[0]]), 1.0);
+            for (auto vertex : triangle)
+            {
+                quadrics[vertex] += plane;
+            }
+        }
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            vertexTriangles[triangle[corner]].push_back(t);
+            ++edgeUses[edgeKey(triangle[corner], triangle[(corner + 1) % 3])];
+        }
+    }
+
+    for (auto &triangle : triangles)
+    {
+        auto normal = triangleNormal(triangle);
+        if (glm::length(normal) == 0.0)
+        {
+            continue;
+        }
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            uint32_t a = triangle[corner], b = triangle[(corner + 1) % 3];
+            if (edgeUses[edgeKey(a, b)] != 1)
+            {
+                continue;
+            }
+
+            auto edge = positions[b] - positions[a];
+            auto borderNormal = glm::cross(edge, normal);
+            double length = glm::length(borderNormal);
+            if (length == 0.0)
+            {
+                continue;
+            }
+            borderNormal /= length;
+            auto plane = Quadric::fromPlane(borderNormal, -glm::dot(borderNormal, positions[a]), BORDER_WEIGHT);
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+        }
+    }
+
+    // Candidate collapses, cheapest first. Entries go stale when either end
+    // changes and are skipped then, the replacement has been pushed already
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t fromVersion, toVersion;
+
+        bool operator>(const Collapse &other) const
+        {
+            return cost > other.cost;
+        }
+    };
+
+    std::vector<uint32_t> versions(vertexCount, 0);
+    std::vector<bool> removed(vertexCount, false);
+    std::vector<bool> triangleAlive(triangles.size(), true);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+
+    auto pushEdge = [&](uint32_t a, uint32_t b)
+    {
+        auto combined = quadrics[a];
+        combined += quadrics[b];
+        double costToB = combined.evaluate(positions[b]);
+        double costToA = combined.evaluate(positions[a]);
+        if (costToB <= costToA)
+        {
+            queue.push({costToB, a, b, versions[a], versions[b]});
+        }
+        else
+        {
+            queue.push({costToA, b, a, versions[b], versions[a]});
+        }
+    };
+
+    for (auto &[key, uses] : edgeUses)
+    {
+        pushEdge(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+    }
+
+    // Collapsing must not turn any surviving triangle around
+    auto flips = [&](uint32_t from, uint32_t to)
+    {
+        for (auto t : vertexTriangles[from])
+        {
+            auto &triangle = triangles[t];
+            if (!triangleAlive[t] || std::ranges::find(triangle, to) != triangle.end())
+            {
+                continue;
+            }
+
+            auto moved = triangle;
+            std::ranges::replace(moved, from, to);
+            auto before = triangleNormal(triangle);
+            auto after = triangleNormal(moved);
+            if (glm::dot(before, after) <= 0.0)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t triangleCount = triangles.size();
+    double maxCost = static_cast<double>(maxError) * maxError;
+    double largestCost = 0.0;
+    std::vector<uint32_t> neighbours;
+
+    while (triangleCount * 3 > targetIndexCount && !queue.empty())
+    {
+        auto collapse = queue.top();
+        queue.pop();
+
+        auto [cost, from, to, fromVersion, toVersion] = collapse;
+        if (removed[from] || removed[to] || versions[from] != fromVersion || versions[to] != toVersion)
+        {
+            continue;
+        }
+        if (cost > maxCost)
+        {
+            break;
+        }
+        if (flips(from, to))
+        {
+            continue;
+        }
+
+        for (auto t : vertexTriangles[from])
+        {
+            if (!triangleAlive[t])
+            {
+                continue;
+            }
+
+            auto &triangle = triangles[t];
+            if (std::ranges::find(triangle, to) != triangle.end())
+            {
+                triangleAlive[t] = false;
+                --triangleCount;
+            }
+            else
+            {
+                std::ranges::replace(triangle, from, to);
+                vertexTriangles[to].push_back(t);
+            }
+        }
+
+        removed[from] = true;
+        vertexTriangles[from].clear();
+        quadrics[to] += quadrics[from];
+        largestCost = std::max(largestCost, cost);
+
+        // Drop dead triangles and requeue every edge around the kept vertex
+        auto &adjacent = vertexTriangles[to];
+        std::erase_if(adjacent, [&](uint32_t t)
+                      { return !triangleAlive[t]; });
+        ++versions[to];
+
+        neighbours.clear();
+        for (auto t : adjacent)
+        {
+            for (auto vertex : triangles[t])
+            {
+                if (vertex != to)
+                {
+                    neighbours.push_back(vertex);
+                }
+            }
+        }
+        std::ranges::sort(neighbours);
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (auto neighbour : neighbours)
+        {
+            pushEdge(to, neighbour);
+        }
+    }
+
+    if (error)
+    {
+        *error = static_cast<float>(std::sqrt(largestCost));
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        if (triangleAlive[t])
+        {
+            for (auto vertex : triangles[t])
+            {
+                result.push_back(representative[vertex]);
+            }
+        }
+    }
+    return result;
+}
+
+// Appends a chain of progressively coarser levels to mesh.indices, each
+// roughly half the triangles of the one before and cache optimized. Stops
+// when a level can't get meaningfully smaller or the error grows too large
+// (in mesh units). Level 0 is the mesh as given
+inline void generateLods(MeshData &mesh, uint32_t maxLods, float maxError)
+{
+    constexpr float REDUCTION = 0.5f;
+    constexpr float MIN_REDUCTION = 0.85f;
+
+    mesh.lods = {{.firstIndex = 0, .indexCount = static_cast<uint32_t>(mesh.indices.size()), .error = 0.0f}};
+
+    std::vector<uint32_t> previous = mesh.indices;
+    while (mesh.lods.size() < maxLods)
+    {
+        auto target = static_cast<size_t>(previous.size() / 3 * REDUCTION) * 3;
+        float error = 0.0f;
+        auto lod = simplifyMesh(mesh.vertices, previous, target, maxError - mesh.lods.back().error, &error);
+        if (lod.empty() || lod.size() > previous.size() * MIN_REDUCTION)
+        {
+            break;
+        }
+
+        optimizeVertexCache(lod, mesh.vertices.size());
+
+        // Errors accumulate from level to level
+        mesh.lods.push_back({
+            .firstIndex = static_cast<uint32_t>(mesh.indices.size()),
+            .indexCount = static_cast<uint32_t>(lod.size()),
+            .error = mesh.lods.back().error + error,
+        });
+        mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+        previous = std::move(lod);
+    }
+}
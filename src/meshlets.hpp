@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vertex_formats.hpp"
+
+// A run of consecutive triangles of an index buffer small enough to be culled
+// as a unit. Laid out as the cull shader reads it (std430)
+struct Meshlet
+{
+    // Bounding sphere in mesh units
+    glm::vec3 center;
+    float radius;
+
+    // Every triangle normal lies within the cone around coneAxis. coneCutoff
+    // is the sine of its half angle, 1 when the meshlet faces every way
+    glm::vec3 coneAxis;
+    float coneCutoff;
+
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t padding[2];
+};
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match the shader's layout");
+
+// Upper bound of the meshlets buildMeshlets makes for indexCount indices. A
+// meshlet is only closed early once fewer than 3 vertex slots are left, so
+// it holds at least maxVertices / 3 triangles
+inline size_t maxMeshletCount(size_t indexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    size_t minTriangles = std::max<size_t>(std::min(maxVertices / 3, maxTriangles), 1);
+    return indexCount / 3 / minTriangles + 1;
+}
+
+// Sphere around the bounding box center of the indexed vertices, xyz is the
+// center and w the radius. Not minimal, but cheap and never too small
+inline glm::vec4 boundingSphere(std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+{
+    if (indices.empty())
+    {
+        return glm::vec4(0.0f);
+    }
+
+    glm::vec3 min(vertices[indices[0]].pos), max = min;
+    for (auto index : indices)
+    {
+        min = glm::min(min, vertices[index].pos);
+        max = glm::max(max, vertices[index].pos);
+    }
+
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (auto index : indices)
+    {
+        radius = std::max(radius, glm::length(vertices[index].pos - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+// Greedily groups triangles in index order, closing a meshlet when the next
+// triangle would exceed either limit. Works best on cache optimized indices,
+// where neighbouring triangles share vertices. firstIndex is relative to
+// indices
+inline std::vector<Meshlet> buildMeshlets(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                          uint32_t maxVertices, uint32_t maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+
+    // Which meshlet last used each vertex, saves clearing a set per meshlet
+    std::vector<uint32_t> lastMeshlet(vertices.size(), UINT32_MAX);
+    uint32_t meshletVertices = 0;
+    uint32_t first = 0;
+
+    auto finish = [&](uint32_t end)
+    {
+        if (end == first)
+        {
+            return;
+        }
+
+        Meshlet meshlet{.firstIndex = first, .indexCount = end - first};
+
+        auto sphere = boundingSphere(vertices, indices.subspan(first, end - first));
+        meshlet.center = glm::vec3(sphere);
+        meshlet.radius = sphere.w;
+
+        // Cone around the average normal, as wide as the furthest normal
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (uint32_t i = first; i < end; i += 3)
+        {
+            auto &a = vertices[indices[i]].pos;
+            auto normal = glm::cross(vertices[indices[i + 1]].pos - a, vertices[indices[i + 2]].pos - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            }
+        }
+
+        float axisLength = glm::length(axis);
+        meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 1.0f;
+        if (axisLength > 0.0f)
+        {
+            float minDot = 1.0f;
+            for (auto &normal : normals)
+            {
+                minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+            }
+            if (minDot > 0.0f)
+            {
+                meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+            }
+        }
+
+        meshlets.push_back(meshlet);
+        first = end;
+        meshletVertices = 0;
+    };
+
+    for (uint32_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        auto meshletIndex = static_cast<uint32_t>(meshlets.size());
+        uint32_t newVertices = 0;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            newVertices += lastMeshlet[indices[i + corner]] != meshletIndex;
+        }
+
+        if (meshletVertices + newVertices > maxVertices || (i - first) / 3 >= maxTriangles)
+        {
+            finish(i);
+            meshletIndex = static_cast<uint32_t>(meshlets.size());
+            newVertices = 3;
+        }
+
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            lastMeshlet[indices[i + corner]] = meshletIndex;
+        }
+        meshletVertices += newVertices;
+    }
+    finish(static_cast<uint32_t>(indices.size() / 3 * 3));
+
+    return meshlets;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+// Hands out ranges of a fixed size pool, in whatever unit the caller uses
+// (vertices, indices). First fit over a free list ordered by offset, freed
+// ranges are merged with their neighbours so the pool doesn't fragment into
+// slivers
+class RangeAllocator
+{
+public:
+    explicit RangeAllocator(uint32_t capacity = 0)
+        : totalCapacity(capacity)
+    {
+        if (capacity > 0)
+        {
+            freeRanges.emplace(0, capacity);
+        }
+    }
+
+    // Offset of count free units, empty when no free range is large enough
+    std::optional<uint32_t> allocate(uint32_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+        {
+            auto [offset, size] = *range;
+            if (size < count)
+            {
+                continue;
+            }
+
+            freeRanges.erase(range);
+            if (size > count)
+            {
+                freeRanges.emplace(offset + count, size - count);
+            }
+            allocatedUnits += count;
+            return offset;
+        }
+
+        return std::nullopt;
+    }
+
+    void free(uint32_t offset, uint32_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (offset + count > totalCapacity)
+        {
+            throw std::runtime_error("Freed range is outside the allocator!");
+        }
+
+        allocatedUnits -= count;
+
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && next->first == offset + count)
+        {
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += count;
+                return;
+            }
+        }
+
+        freeRanges.emplace(offset, count);
+    }
+
+    uint32_t capacity() const
+    {
+        return totalCapacity;
+    }
+
+    uint32_t used() const
+    {
+        return allocatedUnits;
+    }
+
+private:
+    // Free ranges by offset to size
+    std::map<uint32_t, uint32_t> freeRanges;
+    uint32_t totalCapacity;
+    uint32_t allocatedUnits = 0;
+};
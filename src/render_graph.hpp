@@ -0,0 +1,782 @@
+#pragma once
+
+#define VULKAN_HPP_NO_CONSTRUCTORS
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "resource_state_tracker.hpp"
+
+// Frame described as passes that declare the images and buffers they read
+// and write. compile culls passes that contribute nothing to an output,
+// orders the rest by dependency level, creates the transient images and
+// places those whose lifetimes don't overlap in the same memory. execute
+// records the passes with the barriers derived from the declared accesses,
+// batched per dependency level.
+//
+// Transient images only live within one execution. Imported images and
+// buffers are owned elsewhere and rebound with bindImage / bindBuffer before
+// every execution (e.g. the acquired swapchain image).
+class RenderGraph
+{
+    struct ImageUse;
+    struct Pass;
+
+public:
+    using Resource = uint32_t;
+    using ExecuteFunction = std::function<void(const vk::raii::CommandBuffer &)>;
+
+    class PassBuilder
+    {
+    public:
+        void colorAttachment(Resource image, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear,
+                             vk::ClearColorValue clearValue = {})
+        {
+            auto &use = addImageUse(image, vk::ImageLayout::eColorAttachmentOptimal,
+                                    vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+                                    vk::AccessFlagBits2::eColorAttachmentWrite |
+                                        (loadOp == vk::AttachmentLoadOp::eLoad ? vk::AccessFlagBits2::eColorAttachmentRead : vk::AccessFlags2{}),
+                                    vk::ImageUsageFlagBits::eColorAttachment);
+            use.attachment = AttachmentUse{.loadOp = loadOp, .clearValue = clearValue};
+            pass().colorAttachments.push_back(static_cast<uint32_t>(pass().imageUses.size() - 1));
+        }
+
+        // With write disabled the depth is only tested against, e.g. after a depth pre-pass
+        void depthAttachment(Resource image, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear,
+                             float clearDepth = 1.0f, bool write = true)
+        {
+            vk::AccessFlags2 access = vk::AccessFlagBits2::eDepthStencilAttachmentRead;
+            if (write)
+            {
+                access |= vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
+            }
+
+            auto &use = addImageUse(image,
+                                    write ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                                    vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+                                    access, vk::ImageUsageFlagBits::eDepthStencilAttachment);
+            use.attachment = AttachmentUse{.loadOp = loadOp, .clearValue = vk::ClearDepthStencilValue{clearDepth, 0}};
+            pass().depthAttachment = static_cast<uint32_t>(pass().imageUses.size() - 1);
+        }
+
+        // Images also written as storage images are sampled in eGeneral
+        void sampledImage(Resource image, vk::PipelineStageFlags2 stages,
+                          vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal)
+        {
+            addImageUse(image, layout, stages,
+                        vk::AccessFlagBits2::eShaderSampledRead, vk::ImageUsageFlagBits::eSampled);
+        }
+
+        void storageImage(Resource image, vk::PipelineStageFlags2 stages, bool write)
+        {
+            addImageUse(image, vk::ImageLayout::eGeneral, stages,
+                        write ? vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+                              : vk::AccessFlagBits2::eShaderStorageRead,
+                        vk::ImageUsageFlagBits::eStorage);
+        }
+
+        void buffer(Resource buffer, vk::PipelineStageFlags2 stages, vk::AccessFlags2 access)
+        {
+            pass().bufferUses.push_back({.resource = buffer, .stages = stages, .access = access});
+        }
+
+    private:
+        friend class RenderGraph;
+
+        PassBuilder(RenderGraph &graph, uint32_t passIndex) : graph(graph), passIndex(passIndex) {}
+
+        RenderGraph &graph;
+        uint32_t passIndex;
+
+        Pass &pass()
+        {
+            return graph.passes[passIndex];
+        }
+
+        ImageUse &addImageUse(Resource image, vk::ImageLayout layout, vk::PipelineStageFlags2 stages,
+                              vk::AccessFlags2 access, vk::ImageUsageFlags usage)
+        {
+            graph.images[image].usage |= usage;
+            pass().imageUses.push_back({.resource = image, .layout = layout, .stages = stages, .access = access});
+            return pass().imageUses.back();
+        }
+    };
+
+    RenderGraph(const vk::raii::Device &device, const vk::raii::PhysicalDevice &physicalDevice)
+        : device(&device), memoryProperties(physicalDevice.getMemoryProperties())
+    {
+    }
+
+    Resource createImage(std::string name, vk::Format format, vk::Extent2D extent, vk::ImageAspectFlags aspect)
+    {
+        images.push_back({.name = std::move(name), .format = format, .extent = extent, .aspect = aspect});
+        return static_cast<Resource>(images.size() - 1);
+    }
+
+    // The image is expected in initialLayout, last accessed at initialStages.
+    // Barriers cover all mipLevels, passes order accesses between levels
+    // themselves
+    Resource importImage(std::string name, vk::Format format, vk::Extent2D extent, vk::ImageAspectFlags aspect,
+                         vk::ImageLayout initialLayout, vk::PipelineStageFlags2 initialStages, vk::AccessFlags2 initialAccess = {},
+                         uint32_t mipLevels = 1)
+    {
+        images.push_back({
+            .name = std::move(name),
+            .format = format,
+            .extent = extent,
+            .aspect = aspect,
+            .mipLevels = mipLevels,
+            .imported = true,
+            .initialLayout = initialLayout,
+            .initialStages = initialStages,
+            .initialAccess = initialAccess,
+        });
+        return static_cast<Resource>(images.size() - 1);
+    }
+
+    void bindImage(Resource image, vk::Image handle, vk::ImageView view)
+    {
+        images[image].handle = handle;
+        images[image].view = view;
+    }
+
+    Resource importBuffer(std::string name, vk::Buffer handle = nullptr)
+    {
+        buffers.push_back({.name = std::move(name), .handle = handle});
+        return static_cast<Resource>(buffers.size() - 1);
+    }
+
+    void bindBuffer(Resource buffer, vk::Buffer handle)
+    {
+        buffers[buffer].handle = handle;
+    }
+
+    // Passes must be added in an order where every read follows its write
+    void addPass(std::string name, vk::PipelineBindPoint bindPoint,
+                 const std::function<void(PassBuilder &)> &setup, ExecuteFunction execute)
+    {
+        passes.push_back({.name = std::move(name), .bindPoint = bindPoint, .execute = std::move(execute)});
+        PassBuilder builder(*this, static_cast<uint32_t>(passes.size() - 1));
+        setup(builder);
+    }
+
+    // Keeps every pass contributing to image alive and leaves it in finalLayout
+    void markOutput(Resource image, vk::ImageLayout finalLayout)
+    {
+        images[image].output = true;
+        images[image].finalLayout = finalLayout;
+    }
+
+    // Passes writing to buffers have effects the graph can't see, keep them
+    void markBufferOutput(Resource buffer)
+    {
+        buffers[buffer].output = true;
+    }
+
+    void compile()
+    {
+        cullPasses();
+        orderPasses();
+        computeStoreOps();
+        createTransientImages();
+    }
+
+    void execute(const vk::raii::CommandBuffer &commandBuffer) const
+    {
+        ResourceStateTracker tracker;
+
+        for (auto &image : images)
+        {
+            if (image.imported)
+            {
+                tracker.setImageState(image.handle, image.range(), image.initialLayout, image.initialStages, image.initialAccess);
+            }
+            else if (image.handle)
+            {
+                // Whatever last used this memory, in the previous frame or
+                // earlier in this one, has to be done before the first use
+                auto &block = memoryBlocks[image.memoryBlock];
+                tracker.setImageState(image.handle, image.range(), vk::ImageLayout::eUndefined, block.stages, block.writeAccess);
+            }
+        }
+
+        size_t begin = 0;
+        while (begin < order.size())
+        {
+            size_t end = begin;
+            while (end < order.size() && passes[order[end]].level == passes[order[begin]].level)
+            {
+                ++end;
+            }
+
+            // Passes on one level are independent, their barriers go out together
+            for (size_t i = begin; i < end; ++i)
+            {
+                auto &pass = passes[order[i]];
+                for (auto &use : pass.imageUses)
+                {
+                    auto &image = images[use.resource];
+                    tracker.useImage(image.handle, image.range(), use.layout, use.stages, use.access);
+                }
+                for (auto &use : pass.bufferUses)
+                {
+                    tracker.useBuffer(buffers[use.resource].handle, use.stages, use.access);
+                }
+            }
+            tracker.flush(commandBuffer);
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                executePass(commandBuffer, passes[order[i]]);
+            }
+            begin = end;
+        }
+
+        for (auto &image : images)
+        {
+            if (image.output && image.finalLayout != vk::ImageLayout::eUndefined)
+            {
+                tracker.useImage(image.handle, image.range(), image.finalLayout,
+                                 vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone);
+            }
+        }
+        tracker.flush(commandBuffer);
+    }
+
+    vk::Image image(Resource image) const
+    {
+        return images[image].handle;
+    }
+
+    vk::ImageView imageView(Resource image) const
+    {
+        return images[image].view;
+    }
+
+    bool isPassCulled(const std::string &name) const
+    {
+        auto pass = std::ranges::find(passes, name, &Pass::name);
+        return pass == passes.end() || !pass->alive;
+    }
+
+    // Memory backing transient images, with and without aliasing
+    vk::DeviceSize transientMemorySize() const
+    {
+        vk::DeviceSize size = 0;
+        for (auto &block : memoryBlocks)
+        {
+            size += block.size;
+        }
+        return size;
+    }
+
+    vk::DeviceSize unaliasedTransientMemorySize() const
+    {
+        return unaliasedSize;
+    }
+
+private:
+    struct AttachmentUse
+    {
+        vk::AttachmentLoadOp loadOp;
+        vk::AttachmentStoreOp storeOp = vk::AttachmentStoreOp::eStore;
+        vk::ClearValue clearValue;
+    };
+
+    struct ImageUse
+    {
+        Resource resource;
+        vk::ImageLayout layout;
+        vk::PipelineStageFlags2 stages;
+        vk::AccessFlags2 access;
+        std::optional<AttachmentUse> attachment;
+
+        bool writes() const
+        {
+            return static_cast<bool>(access & (vk::AccessFlagBits2::eColorAttachmentWrite |
+                                               vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+                                               vk::AccessFlagBits2::eShaderStorageWrite));
+        }
+
+        bool reads() const
+        {
+            return !attachment || attachment->loadOp == vk::AttachmentLoadOp::eLoad || !writes();
+        }
+    };
+
+    struct BufferUse
+    {
+        Resource resource;
+        vk::PipelineStageFlags2 stages;
+        vk::AccessFlags2 access;
+
+        static constexpr vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite |
+                                                         vk::AccessFlagBits2::eShaderStorageWrite |
+                                                         vk::AccessFlagBits2::eTransferWrite;
+
+        bool writes() const
+        {
+            return static_cast<bool>(access & WRITE_ACCESS);
+        }
+
+        bool reads() const
+        {
+            return static_cast<bool>(access & ~WRITE_ACCESS);
+        }
+    };
+
+    struct Pass
+    {
+        std::string name;
+        vk::PipelineBindPoint bindPoint;
+        ExecuteFunction execute;
+
+        std::vector<ImageUse> imageUses;
+        std::vector<BufferUse> bufferUses;
+        std::vector<uint32_t> colorAttachments;
+        std::optional<uint32_t> depthAttachment;
+
+        bool alive = false;
+        uint32_t level = 0;
+    };
+
+    struct Image
+    {
+        std::string name;
+        vk::Format format;
+        vk::Extent2D extent;
+        vk::ImageAspectFlags aspect;
+        vk::ImageUsageFlags usage;
+        uint32_t mipLevels = 1;
+
+        bool imported = false;
+        vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags2 initialStages;
+        vk::AccessFlags2 initialAccess;
+
+        bool output = false;
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+
+        vk::Image handle;
+        vk::ImageView view;
+
+        // Transient images only
+        uint32_t firstUse = UINT32_MAX;
+        uint32_t lastUse = 0;
+        uint32_t memoryBlock = 0;
+        vk::DeviceSize memoryOffset = 0;
+
+        vk::ImageSubresourceRange range() const
+        {
+            return {.aspectMask = aspect, .baseMipLevel = 0, .levelCount = mipLevels, .baseArrayLayer = 0, .layerCount = 1};
+        }
+    };
+
+    struct Buffer
+    {
+        std::string name;
+        vk::Buffer handle;
+        bool output = false;
+    };
+
+    // All transient images placed in one allocation
+    struct MemoryBlock
+    {
+        uint32_t memoryTypeIndex;
+        vk::DeviceSize size = 0;
+        vk::PipelineStageFlags2 stages;
+        vk::AccessFlags2 writeAccess;
+    };
+
+    const vk::raii::Device *device;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+
+    std::vector<Pass> passes;
+    std::vector<Image> images;
+    std::vector<Buffer> buffers;
+    std::vector<uint32_t> order;
+
+    std::vector<vk::raii::Image> transientImages;
+    std::vector<vk::raii::ImageView> transientImageViews;
+    std::vector<vk::raii::DeviceMemory> memory;
+    std::vector<MemoryBlock> memoryBlocks;
+    vk::DeviceSize unaliasedSize = 0;
+
+    void cullPasses()
+    {
+        std::vector<bool> imageNeeded(images.size()), bufferNeeded(buffers.size());
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            imageNeeded[i] = images[i].output;
+        }
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            bufferNeeded[i] = buffers[i].output;
+        }
+
+        for (auto &pass : std::views::reverse(passes))
+        {
+            pass.alive =
+                std::ranges::any_of(pass.imageUses, [&](auto &use)
+                                    { return use.writes() && imageNeeded[use.resource]; }) ||
+                std::ranges::any_of(pass.bufferUses, [&](auto &use)
+                                    { return use.writes() && bufferNeeded[use.resource]; });
+
+            if (!pass.alive)
+            {
+                continue;
+            }
+
+            for (auto &use : pass.imageUses)
+            {
+                if (use.reads())
+                {
+                    imageNeeded[use.resource] = true;
+                }
+            }
+            for (auto &use : pass.bufferUses)
+            {
+                if (use.reads())
+                {
+                    bufferNeeded[use.resource] = true;
+                }
+            }
+        }
+    }
+
+    // Levels follow read-after-write, write-after-read and write-after-write
+    // hazards between live passes in declaration order. Reading an image in
+    // another layout than the readers before it transitions the image, so it
+    // comes after them like a write would. Passes on one level therefore
+    // agree on every shared image's layout
+    void orderPasses()
+    {
+        struct Hazards
+        {
+            std::optional<uint32_t> lastWriterLevel;
+            uint32_t lastReaderLevel = 0;
+            bool hasReaders = false;
+            vk::ImageLayout readLayout = vk::ImageLayout::eUndefined;
+        };
+        std::vector<Hazards> imageHazards(images.size()), bufferHazards(buffers.size());
+
+        auto dependencyLevel = [](const Hazards &hazards, bool writes, vk::ImageLayout layout)
+        {
+            uint32_t level = 0;
+            if (hazards.lastWriterLevel)
+            {
+                level = *hazards.lastWriterLevel + 1;
+            }
+            if ((writes || layout != hazards.readLayout) && hazards.hasReaders)
+            {
+                level = std::max(level, hazards.lastReaderLevel + 1);
+            }
+            return level;
+        };
+
+        auto recordAccess = [](Hazards &hazards, uint32_t level, bool writes, vk::ImageLayout layout)
+        {
+            if (writes)
+            {
+                hazards = {.lastWriterLevel = level};
+            }
+            else
+            {
+                // A reader in a new layout came after every earlier reader
+                bool sameLayout = hazards.hasReaders && layout == hazards.readLayout;
+                hazards.lastReaderLevel = sameLayout ? std::max(hazards.lastReaderLevel, level) : level;
+                hazards.hasReaders = true;
+                hazards.readLayout = layout;
+            }
+        };
+
+        order.clear();
+        for (uint32_t i = 0; i < passes.size(); ++i)
+        {
+            auto &pass = passes[i];
+            if (!pass.alive)
+            {
+                continue;
+            }
+
+            pass.level = 0;
+            for (auto &use : pass.imageUses)
+            {
+                pass.level = std::max(pass.level, dependencyLevel(imageHazards[use.resource], use.writes(), use.layout));
+            }
+            for (auto &use : pass.bufferUses)
+            {
+                pass.level = std::max(pass.level, dependencyLevel(bufferHazards[use.resource], use.writes(), vk::ImageLayout::eUndefined));
+            }
+
+            for (auto &use : pass.imageUses)
+            {
+                recordAccess(imageHazards[use.resource], pass.level, use.writes(), use.layout);
+            }
+            for (auto &use : pass.bufferUses)
+            {
+                recordAccess(bufferHazards[use.resource], pass.level, use.writes(), vk::ImageLayout::eUndefined);
+            }
+
+            order.push_back(i);
+        }
+
+        std::ranges::stable_sort(order, {}, [this](uint32_t pass)
+                                 { return passes[pass].level; });
+
+        for (uint32_t position = 0; position < order.size(); ++position)
+        {
+            for (auto &use : passes[order[position]].imageUses)
+            {
+                auto &image = images[use.resource];
+                image.firstUse = std::min(image.firstUse, position);
+                image.lastUse = std::max(image.lastUse, position);
+            }
+        }
+    }
+
+    // Attachments nobody reads afterwards don't need to be written to memory
+    void computeStoreOps()
+    {
+        for (uint32_t position = 0; position < order.size(); ++position)
+        {
+            for (auto &use : passes[order[position]].imageUses)
+            {
+                if (!use.attachment)
+                {
+                    continue;
+                }
+
+                auto &image = images[use.resource];
+                bool readLater = image.imported || image.output ||
+                                 std::ranges::any_of(order.begin() + position + 1, order.end(), [&](uint32_t later)
+                                                     { return std::ranges::any_of(passes[later].imageUses, [&](auto &laterUse)
+                                                                                  { return laterUse.resource == use.resource && laterUse.reads(); }); });
+
+                use.attachment->storeOp = readLater ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+            }
+        }
+    }
+
+    void createTransientImages()
+    {
+        struct Placement
+        {
+            Resource image;
+            vk::MemoryRequirements requirements;
+            uint32_t memoryTypeIndex;
+        };
+        std::vector<Placement> placements;
+
+        for (Resource i = 0; i < images.size(); ++i)
+        {
+            auto &image = images[i];
+            if (image.imported || image.firstUse == UINT32_MAX)
+            {
+                continue;
+            }
+
+            // Attachment-only images may never need to leave tile memory
+            auto usage = image.usage;
+            if (!(usage & ~(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment)))
+            {
+                usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+            }
+
+            transientImages.push_back(device->createImage({
+                .imageType = vk::ImageType::e2D,
+                .format = image.format,
+                .extent = {image.extent.width, image.extent.height, 1},
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = vk::SampleCountFlagBits::e1,
+                .tiling = vk::ImageTiling::eOptimal,
+                .usage = usage,
+                .sharingMode = vk::SharingMode::eExclusive,
+                .initialLayout = vk::ImageLayout::eUndefined,
+            }));
+            image.handle = *transientImages.back();
+
+            auto requirements = transientImages.back().getMemoryRequirements();
+            bool lazy = static_cast<bool>(usage & vk::ImageUsageFlagBits::eTransientAttachment);
+            placements.push_back({i, requirements, findMemoryType(requirements.memoryTypeBits, lazy)});
+            unaliasedSize += requirements.size;
+        }
+
+        // Largest first, each at the lowest offset not overlapping any image
+        // of the same memory type that is alive at the same time
+        std::ranges::stable_sort(placements, std::greater{}, [](auto &placement)
+                                 { return placement.requirements.size; });
+
+        std::vector<Placement> placed;
+        for (auto &placement : placements)
+        {
+            auto &image = images[placement.image];
+
+            auto block = std::ranges::find(memoryBlocks, placement.memoryTypeIndex, &MemoryBlock::memoryTypeIndex);
+            if (block == memoryBlocks.end())
+            {
+                memoryBlocks.push_back({.memoryTypeIndex = placement.memoryTypeIndex});
+                block = memoryBlocks.end() - 1;
+            }
+            image.memoryBlock = static_cast<uint32_t>(block - memoryBlocks.begin());
+
+            std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> occupied;
+            for (auto &other : placed)
+            {
+                auto &otherImage = images[other.image];
+                bool lifetimesOverlap = otherImage.firstUse <= image.lastUse && image.firstUse <= otherImage.lastUse;
+                if (otherImage.memoryBlock == image.memoryBlock && lifetimesOverlap)
+                {
+                    occupied.emplace_back(otherImage.memoryOffset, otherImage.memoryOffset + other.requirements.size);
+                }
+            }
+            std::ranges::sort(occupied);
+
+            auto alignment = placement.requirements.alignment;
+            vk::DeviceSize offset = 0;
+            for (auto [begin, end] : occupied)
+            {
+                if (offset + placement.requirements.size <= begin)
+                {
+                    break;
+                }
+                offset = std::max(offset, (end + alignment - 1) / alignment * alignment);
+            }
+
+            image.memoryOffset = offset;
+            block->size = std::max(block->size, offset + placement.requirements.size);
+            placed.push_back(placement);
+        }
+
+        for (auto &block : memoryBlocks)
+        {
+            memory.push_back(device->allocateMemory({
+                .allocationSize = block.size,
+                .memoryTypeIndex = block.memoryTypeIndex,
+            }));
+        }
+
+        size_t transientIndex = 0;
+        for (auto &image : images)
+        {
+            if (image.imported || image.firstUse == UINT32_MAX)
+            {
+                continue;
+            }
+
+            auto &block = memoryBlocks[image.memoryBlock];
+            transientImages[transientIndex++].bindMemory(*memory[image.memoryBlock], image.memoryOffset);
+
+            transientImageViews.push_back(device->createImageView({
+                .image = image.handle,
+                .viewType = vk::ImageViewType::e2D,
+                .format = image.format,
+                .subresourceRange = image.range(),
+            }));
+            image.view = *transientImageViews.back();
+
+            for (auto &pass : passes)
+            {
+                for (auto &use : pass.imageUses)
+                {
+                    if (&images[use.resource] == &image)
+                    {
+                        block.stages |= use.stages;
+                        block.writeAccess |= use.access;
+                    }
+                }
+            }
+        }
+    }
+
+    // Attachments that never leave tile memory prefer lazily allocated memory,
+    // which tiled GPUs may not back at all
+    uint32_t findMemoryType(uint32_t typeFilter, bool preferLazy) const
+    {
+        auto find = [&](vk::MemoryPropertyFlags properties) -> std::optional<uint32_t>
+        {
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+            {
+                if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+                {
+                    return i;
+                }
+            }
+            return std::nullopt;
+        };
+
+        if (preferLazy)
+        {
+            if (auto memoryType = find(vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated))
+            {
+                return *memoryType;
+            }
+        }
+
+        if (auto memoryType = find(vk::MemoryPropertyFlagBits::eDeviceLocal))
+        {
+            return *memoryType;
+        }
+
+        throw std::runtime_error("Failed to find a suitable memory type for a transient image!");
+    }
+
+    void executePass(const vk::raii::CommandBuffer &commandBuffer, const Pass &pass) const
+    {
+        if (pass.bindPoint != vk::PipelineBindPoint::eGraphics)
+        {
+            pass.execute(commandBuffer);
+            return;
+        }
+
+        auto attachmentInfo = [&](uint32_t useIndex)
+        {
+            auto &use = pass.imageUses[useIndex];
+            return vk::RenderingAttachmentInfo{
+                .imageView = images[use.resource].view,
+                .imageLayout = use.layout,
+                .loadOp = use.attachment->loadOp,
+                .storeOp = use.attachment->storeOp,
+                .clearValue = use.attachment->clearValue,
+            };
+        };
+
+        std::vector<vk::RenderingAttachmentInfo> colorAttachments;
+        for (auto useIndex : pass.colorAttachments)
+        {
+            colorAttachments.push_back(attachmentInfo(useIndex));
+        }
+
+        std::optional<vk::RenderingAttachmentInfo> depthAttachment;
+        if (pass.depthAttachment)
+        {
+            depthAttachment = attachmentInfo(*pass.depthAttachment);
+        }
+
+        auto firstAttachment = pass.colorAttachments.empty() ? *pass.depthAttachment : pass.colorAttachments.front();
+        vk::Rect2D renderArea{
+            .offset = {0, 0},
+            .extent = images[pass.imageUses[firstAttachment].resource].extent,
+        };
+
+        commandBuffer.beginRendering({
+            .renderArea = renderArea,
+            .layerCount = 1,
+            .colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size()),
+            .pColorAttachments = colorAttachments.data(),
+            .pDepthAttachment = depthAttachment ? &*depthAttachment : nullptr,
+        });
+
+        pass.execute(commandBuffer);
+
+        commandBuffer.endRendering();
+    }
+};
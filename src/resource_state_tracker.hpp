@@ -0,0 +1,268 @@
+#pragma once
+
+#define VULKAN_HPP_NO_CONSTRUCTORS
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Remembers the last accesses to images and buffers within a command buffer
+// and turns each new access into the smallest barrier that orders it, or
+// none at all (e.g. read after read in the same layout). Barriers are
+// collected and emitted together by flush as one vkCmdPipelineBarrier2.
+//
+// State is per whole image/buffer. Resources whose contents or layout carry
+// over from earlier submissions must be seeded with setImageState or
+// setBufferState, anything else starts out undefined and untouched.
+//
+// Uses between two flushes are treated as concurrent, so they must agree on
+// the image layout. Flush in between when they don't.
+class ResourceStateTracker
+{
+public:
+    void setImageState(vk::Image image, vk::ImageSubresourceRange range, vk::ImageLayout layout,
+                       vk::PipelineStageFlags2 stages = {}, vk::AccessFlags2 access = {})
+    {
+        auto &state = images[image];
+        state.range = range;
+        state.access = {};
+        state.access.layout = layout;
+        state.access.writeStages = stages;
+        state.access.writeAccess = access & WRITE_ACCESS;
+    }
+
+    void setBufferState(vk::Buffer buffer, vk::PipelineStageFlags2 stages = {}, vk::AccessFlags2 access = {})
+    {
+        auto &state = buffers[buffer];
+        state.access = {};
+        state.access.writeStages = stages;
+        state.access.writeAccess = access & WRITE_ACCESS;
+    }
+
+    // Declares that the following commands access image in layout from stages
+    void useImage(vk::Image image, vk::ImageSubresourceRange range, vk::ImageLayout layout,
+                  vk::PipelineStageFlags2 stages, vk::AccessFlags2 access)
+    {
+        auto [iterator, inserted] = images.try_emplace(image);
+        auto &state = iterator->second;
+        if (inserted)
+        {
+            state.range = range;
+        }
+
+        if (state.pendingBarrier && imageBarriers[*state.pendingBarrier].newLayout != layout)
+        {
+            throw std::runtime_error("Concurrent image uses need the same layout, flush between them!");
+        }
+
+        auto earlier = state.access;
+        auto barrier = state.access.use(layout, stages, access);
+        if (state.pendingBarrier)
+        {
+            state.access.mergeConcurrent(earlier);
+        }
+        if (!barrier)
+        {
+            return;
+        }
+
+        if (state.pendingBarrier)
+        {
+            // Both uses follow the same flush, widen the barrier already queued
+            auto &pending = imageBarriers[*state.pendingBarrier];
+            pending.dstStageMask |= stages;
+            pending.dstAccessMask |= access;
+            return;
+        }
+
+        state.pendingBarrier = imageBarriers.size();
+        imageBarriers.push_back({
+            .srcStageMask = barrier->srcStages,
+            .srcAccessMask = barrier->srcAccess,
+            .dstStageMask = stages,
+            .dstAccessMask = access,
+            .oldLayout = barrier->oldLayout,
+            .newLayout = layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = state.range,
+        });
+    }
+
+    void useBuffer(vk::Buffer buffer, vk::PipelineStageFlags2 stages, vk::AccessFlags2 access)
+    {
+        auto &state = buffers[buffer];
+
+        auto earlier = state.access;
+        auto barrier = state.access.use(vk::ImageLayout::eUndefined, stages, access);
+        if (state.pendingBarrier)
+        {
+            state.access.mergeConcurrent(earlier);
+        }
+        if (!barrier)
+        {
+            return;
+        }
+
+        if (state.pendingBarrier)
+        {
+            auto &pending = bufferBarriers[*state.pendingBarrier];
+            pending.dstStageMask |= stages;
+            pending.dstAccessMask |= access;
+            return;
+        }
+
+        state.pendingBarrier = bufferBarriers.size();
+        bufferBarriers.push_back({
+            .srcStageMask = barrier->srcStages,
+            .srcAccessMask = barrier->srcAccess,
+            .dstStageMask = stages,
+            .dstAccessMask = access,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        });
+    }
+
+    // Records every barrier queued since the last flush
+    void flush(const vk::raii::CommandBuffer &commandBuffer)
+    {
+        if (imageBarriers.empty() && bufferBarriers.empty())
+        {
+            return;
+        }
+
+        commandBuffer.pipelineBarrier2(vk::DependencyInfo{}
+                                           .setBufferMemoryBarriers(bufferBarriers)
+                                           .setImageMemoryBarriers(imageBarriers));
+
+        for (auto &barrier : imageBarriers)
+        {
+            images[barrier.image].pendingBarrier.reset();
+        }
+        for (auto &barrier : bufferBarriers)
+        {
+            buffers[barrier.buffer].pendingBarrier.reset();
+        }
+        imageBarriers.clear();
+        bufferBarriers.clear();
+    }
+
+    vk::ImageLayout imageLayout(vk::Image image) const
+    {
+        auto iterator = images.find(image);
+        return iterator == images.end() ? vk::ImageLayout::eUndefined : iterator->second.access.layout;
+    }
+
+private:
+    static constexpr vk::AccessFlags2 WRITE_ACCESS =
+        vk::AccessFlagBits2::eShaderWrite |
+        vk::AccessFlagBits2::eColorAttachmentWrite |
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+        vk::AccessFlagBits2::eTransferWrite |
+        vk::AccessFlagBits2::eHostWrite |
+        vk::AccessFlagBits2::eMemoryWrite |
+        vk::AccessFlagBits2::eShaderStorageWrite;
+
+    struct Barrier
+    {
+        vk::PipelineStageFlags2 srcStages;
+        vk::AccessFlags2 srcAccess;
+        vk::ImageLayout oldLayout;
+    };
+
+    struct AccessState
+    {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+
+        // Last write (or layout transition) and who has already waited on it
+        vk::PipelineStageFlags2 writeStages;
+        vk::AccessFlags2 writeAccess;
+        vk::PipelineStageFlags2 visibleStages;
+        vk::AccessFlags2 visibleAccess;
+
+        // Reads since the last write, a following write has to wait for them
+        vk::PipelineStageFlags2 readStages;
+
+        std::optional<Barrier> use(vk::ImageLayout newLayout, vk::PipelineStageFlags2 stages, vk::AccessFlags2 access)
+        {
+            bool isWrite = static_cast<bool>(access & WRITE_ACCESS);
+            bool layoutChange = newLayout != layout;
+            std::optional<Barrier> barrier;
+
+            if (isWrite || layoutChange)
+            {
+                // Write after read only needs an execution dependency
+                if (layoutChange || writeStages || readStages)
+                {
+                    barrier = Barrier{
+                        .srcStages = writeStages | readStages,
+                        .srcAccess = writeAccess,
+                        .oldLayout = layout,
+                    };
+                }
+
+                // A layout transition counts as a write made visible to the
+                // destination of its barrier
+                layout = newLayout;
+                writeStages = stages;
+                writeAccess = access & WRITE_ACCESS;
+                visibleStages = stages;
+                visibleAccess = access;
+                readStages = isWrite ? vk::PipelineStageFlags2{} : stages;
+                return barrier;
+            }
+
+            bool alreadyVisible = (visibleStages & stages) == stages && (visibleAccess & access) == access;
+            if (writeStages && !alreadyVisible)
+            {
+                barrier = Barrier{
+                    .srcStages = writeStages,
+                    .srcAccess = writeAccess,
+                    .oldLayout = layout,
+                };
+                visibleStages |= stages;
+                visibleAccess |= access;
+            }
+
+            readStages |= stages;
+            return barrier;
+        }
+
+        // Keeps what an earlier use behind the same pending barrier did, a
+        // later write or transition would otherwise forget its stages
+        void mergeConcurrent(const AccessState &earlier)
+        {
+            writeStages |= earlier.writeStages;
+            writeAccess |= earlier.writeAccess;
+            visibleStages |= earlier.visibleStages;
+            visibleAccess |= earlier.visibleAccess;
+            readStages |= earlier.readStages;
+        }
+    };
+
+    struct ImageState
+    {
+        vk::ImageSubresourceRange range;
+        AccessState access;
+        std::optional<size_t> pendingBarrier;
+    };
+
+    struct BufferState
+    {
+        AccessState access;
+        std::optional<size_t> pendingBarrier;
+    };
+
+    std::unordered_map<vk::Image, ImageState> images;
+    std::unordered_map<vk::Buffer, BufferState> buffers;
+
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+};
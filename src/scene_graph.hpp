@@ -0,0 +1,243 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "job_system.hpp"
+#include "transform_store.hpp"
+
+inline constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+// Transform hierarchy stored flat in depth-first order, so every subtree is
+// the node's position followed by subtreeSize - 1 descendants. Setting a
+// node's transform only flags it, update then walks the subtrees of flagged
+// nodes and leaves the rest untouched, costing the size of what changed.
+// Nodes are named by ids that stay valid while positions shift on insertion
+class SceneGraph
+{
+public:
+    // parent is NO_PARENT or an existing node. boundsCenter and boundsExtent
+    // are the node's box in its own space. The node goes at the end of its
+    // parent's subtree, building the tree depth first only ever appends,
+    // other orders shift the nodes behind it
+    uint32_t addNode(uint32_t parent, glm::vec3 boundsCenter, glm::vec3 boundsExtent)
+    {
+        auto id = static_cast<uint32_t>(positions.size());
+        auto count = static_cast<uint32_t>(ids.size()) + 1;
+        uint32_t parentPosition = parent == NO_PARENT ? NO_PARENT : positions[parent];
+        uint32_t position = parent == NO_PARENT ? count - 1 : parentPosition + subtreeSizes[parentPosition];
+
+        parents.push_back(NO_PARENT);
+        subtreeSizes.push_back(1);
+        ids.push_back(id);
+        local.resize(count);
+        localMatrices.resize(count);
+        world.resize(count);
+        worldBounds.resize(count);
+        versions.push_back(0);
+        localDirty.push_back(0);
+
+        if (position != count - 1)
+        {
+            insertAt(position);
+        }
+
+        positions.push_back(position);
+        parents[position] = parentPosition;
+        subtreeSizes[position] = 1;
+        ids[position] = id;
+        versions[position] = 0;
+        for (uint32_t ancestor = parentPosition; ancestor != NO_PARENT; ancestor = parents[ancestor])
+        {
+            ++subtreeSizes[ancestor];
+        }
+
+        local.localBounds.center.set(position, boundsCenter);
+        local.localBounds.extent.set(position, boundsExtent);
+        localDirty[position] = 0;
+        setTransform(id, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f);
+        return id;
+    }
+
+    void setTransform(uint32_t node, glm::vec3 translation, glm::quat rotation, float scale)
+    {
+        uint32_t position = positions[node];
+        local.set(position, translation, rotation, scale);
+        if (!localDirty[position])
+        {
+            localDirty[position] = 1;
+            dirtyNodes.push_back(node);
+        }
+    }
+
+    // Brings the world matrices and boxes up to date. Runs of consecutive
+    // dirty nodes are composed batchSize at a time on the job system. Every
+    // node whose world transform changed gets the new version()
+    void update(JobSystem &jobSystem, uint32_t batchSize)
+    {
+        ++currentVersion;
+        if (dirtyNodes.empty())
+        {
+            return;
+        }
+
+        dirtyPositions.clear();
+        for (auto node : dirtyNodes)
+        {
+            dirtyPositions.push_back(positions[node]);
+        }
+        std::ranges::sort(dirtyPositions);
+        dirtyNodes.clear();
+
+        // Local matrices. For roots these are already the world matrices and
+        // boxes, children redo their box below
+        for (size_t first = 0; first < dirtyPositions.size();)
+        {
+            size_t last = first + 1;
+            while (last < dirtyPositions.size() && dirtyPositions[last] == dirtyPositions[last - 1] + 1)
+            {
+                ++last;
+            }
+
+            uint32_t begin = dirtyPositions[first];
+            jobSystem.parallelFor(dirtyPositions[last - 1] + 1 - begin, batchSize, [&](uint32_t runBegin, uint32_t runEnd)
+                                  { composeTransforms(local, begin + runBegin, begin + runEnd, localMatrices.data(), worldBounds); });
+            first = last;
+        }
+
+        // Every node in a dirty node's subtree moves with it. Dirty nodes
+        // inside a subtree already walked are covered by it
+        uint32_t walkedEnd = 0;
+        for (auto dirty : dirtyPositions)
+        {
+            localDirty[dirty] = 0;
+            if (dirty < walkedEnd)
+            {
+                continue;
+            }
+
+            walkedEnd = dirty + subtreeSizes[dirty];
+            for (uint32_t position = dirty; position < walkedEnd; ++position)
+            {
+                uint32_t parent = parents[position];
+                if (parent == NO_PARENT)
+                {
+                    world[position] = localMatrices[position];
+                }
+                else
+                {
+                    world[position] = world[parent] * localMatrices[position];
+                    transformBox(position);
+                }
+                versions[position] = currentVersion;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return ids.size();
+    }
+
+    // Counts calls to update, a node's version is the last one that changed it
+    uint64_t version() const
+    {
+        return currentVersion;
+    }
+
+    uint64_t nodeVersion(uint32_t node) const
+    {
+        return versions[positions[node]];
+    }
+
+    const glm::mat4 &worldMatrix(uint32_t node) const
+    {
+        return world[positions[node]];
+    }
+
+    glm::vec3 worldBoxCenter(uint32_t node) const
+    {
+        return worldBounds.center.get(positions[node]);
+    }
+
+    glm::vec3 worldBoxExtent(uint32_t node) const
+    {
+        return worldBounds.extent.get(positions[node]);
+    }
+
+private:
+    // Indexed by depth-first position, parents holds positions too
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> subtreeSizes;
+    std::vector<uint32_t> ids;
+    TransformStore local;
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> world;
+    BoxBounds worldBounds;
+    std::vector<uint64_t> versions;
+    std::vector<uint8_t> localDirty;
+
+    // Indexed by id
+    std::vector<uint32_t> positions;
+
+    uint64_t currentVersion = 0;
+    std::vector<uint32_t> dirtyNodes;
+    std::vector<uint32_t> dirtyPositions;
+
+    // Moves the just appended last element of every array to position
+    void insertAt(uint32_t position)
+    {
+        auto shift = [&](auto &array)
+        {
+            std::rotate(array.begin() + position, array.end() - 1, array.end());
+        };
+        auto shiftVec3 = [&](SoaVec3 &array)
+        {
+            shift(array.x);
+            shift(array.y);
+            shift(array.z);
+        };
+
+        shift(parents);
+        shift(subtreeSizes);
+        shift(ids);
+        shiftVec3(local.position);
+        shift(local.rotationX);
+        shift(local.rotationY);
+        shift(local.rotationZ);
+        shift(local.rotationW);
+        shift(local.scale);
+        shiftVec3(local.localBounds.center);
+        shiftVec3(local.localBounds.extent);
+        shift(localMatrices);
+        shift(world);
+        shiftVec3(worldBounds.center);
+        shiftVec3(worldBounds.extent);
+        shift(versions);
+        shift(localDirty);
+
+        for (uint32_t i = position + 1; i < ids.size(); ++i)
+        {
+            ++positions[ids[i]];
+            if (parents[i] != NO_PARENT && parents[i] >= position)
+            {
+                ++parents[i];
+            }
+        }
+    }
+
+    // World box of a child from its world matrix and own space box
+    void transformBox(uint32_t position)
+    {
+        auto &matrix = world[position];
+        glm::vec3 center = local.localBounds.center.get(position);
+        glm::vec3 extent = local.localBounds.extent.get(position);
+        worldBounds.center.set(position, glm::vec3(matrix * glm::vec4(center, 1.0f)));
+        worldBounds.extent.set(position, glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y +
+                                             glm::abs(glm::vec3(matrix[2])) * extent.z);
+    }
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Object transforms and bounds kept as one array per component, so the
+// kernels below load the same component of 4 (SSE2) or 8 (AVX2) objects with
+// one instruction. The instruction set is picked at compile time, AVX2 needs
+// -mavx2. Without either the scalar glm versions are used
+
+#if defined(__AVX2__)
+#define TRANSFORM_SIMD_WIDTH 8
+inline constexpr const char *TRANSFORM_SIMD_NAME = "AVX2";
+#elif defined(__SSE2__)
+#define TRANSFORM_SIMD_WIDTH 4
+inline constexpr const char *TRANSFORM_SIMD_NAME = "SSE2";
+#else
+inline constexpr const char *TRANSFORM_SIMD_NAME = "scalar";
+#endif
+
+struct SoaVec3
+{
+    std::vector<float> x, y, z;
+
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+
+    void set(size_t i, glm::vec3 value)
+    {
+        x[i] = value.x;
+        y[i] = value.y;
+        z[i] = value.z;
+    }
+
+    glm::vec3 get(size_t i) const
+    {
+        return {x[i], y[i], z[i]};
+    }
+};
+
+// Axis aligned boxes as center and half extent
+struct BoxBounds
+{
+    SoaVec3 center;
+    SoaVec3 extent;
+
+    void resize(size_t count)
+    {
+        center.resize(count);
+        extent.resize(count);
+    }
+};
+
+// Translation, unit quaternion rotation and uniform scale per object, plus
+// the object space box that follows the object around
+struct TransformStore
+{
+    SoaVec3 position;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scale;
+    BoxBounds localBounds;
+
+    void resize(size_t count)
+    {
+        position.resize(count);
+        rotationX.resize(count);
+        rotationY.resize(count);
+        rotationZ.resize(count);
+        rotationW.resize(count);
+        scale.resize(count, 1.0f);
+        localBounds.resize(count);
+    }
+
+    size_t size() const
+    {
+        return scale.size();
+    }
+
+    void set(size_t i, glm::vec3 translation, glm::quat rotation, float uniformScale)
+    {
+        position.set(i, translation);
+        rotationX[i] = rotation.x;
+        rotationY[i] = rotation.y;
+        rotationZ[i] = rotation.z;
+        rotationW[i] = rotation.w;
+        scale[i] = uniformScale;
+    }
+};
+
+// Planes as (normal, distance) with the normals pointing inside. They are
+// left unnormalized, the box test only looks at signs
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes;
+
+    // The clip volume -w <= x, y, z <= w of viewProj. For a 0..1 depth range
+    // the near plane sits a little behind the real one, which is conservative
+    static Frustum fromMatrix(const glm::mat4 &viewProj)
+    {
+        auto row = [&](int r)
+        {
+            return glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+        };
+        return {{row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2)}};
+    }
+};
+
+// Writes the model matrix and world space box of objects [begin, end).
+// matrices and worldBounds are indexed by object like store
+inline void composeTransformsScalar(const TransformStore &store, uint32_t begin, uint32_t end,
+                                    glm::mat4 *matrices, BoxBounds &worldBounds)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        glm::quat rotation(store.rotationW[i], store.rotationX[i], store.rotationY[i], store.rotationZ[i]);
+        glm::mat3 basis = glm::mat3_cast(rotation) * store.scale[i];
+        glm::vec3 position = store.position.get(i);
+        matrices[i] = glm::mat4(glm::vec4(basis[0], 0.0f), glm::vec4(basis[1], 0.0f), glm::vec4(basis[2], 0.0f), glm::vec4(position, 1.0f));
+
+        // Extent through the absolute basis keeps the box around the rotated one
+        glm::vec3 extent = store.localBounds.extent.get(i);
+        worldBounds.center.set(i, basis * store.localBounds.center.get(i) + position);
+        worldBounds.extent.set(i, glm::abs(basis[0]) * extent.x + glm::abs(basis[1]) * extent.y + glm::abs(basis[2]) * extent.z);
+    }
+}
+
+// visible[i] is 1 when box i is at least partly inside the frustum
+inline void cullBoxesScalar(const BoxBounds &bounds, const Frustum &frustum, uint32_t begin, uint32_t end, uint8_t *visible)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        glm::vec3 center = bounds.center.get(i);
+        glm::vec3 extent = bounds.extent.get(i);
+
+        bool inside = true;
+        for (auto &plane : frustum.planes)
+        {
+            glm::vec3 normal(plane);
+            inside = inside && glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) >= 0.0f;
+        }
+        visible[i] = inside;
+    }
+}
+
+#ifdef TRANSFORM_SIMD_WIDTH
+
+// TRANSFORM_SIMD_WIDTH floats, one per object
+struct SimdFloat
+{
+#if TRANSFORM_SIMD_WIDTH == 8
+    __m256 v;
+
+    static SimdFloat load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static SimdFloat broadcast(float value) { return {_mm256_set1_ps(value)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend SimdFloat operator|(SimdFloat a, SimdFloat b) { return {_mm256_or_ps(a.v, b.v)}; }
+    friend SimdFloat abs(SimdFloat a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+
+    // All bits set in lanes where a < b
+    friend SimdFloat lessThan(SimdFloat a, SimdFloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+
+    // Sign bit of every lane, lane 0 in bit 0
+    int signs() const { return _mm256_movemask_ps(v); }
+
+    // Lanes 4 * index to 4 * index + 3
+    __m128 quarter(uint32_t index) const
+    {
+        return index == 0 ? _mm256_castps256_ps128(v) : _mm256_extractf128_ps(v, 1);
+    }
+#else
+    __m128 v;
+
+    static SimdFloat load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static SimdFloat broadcast(float value) { return {_mm_set1_ps(value)}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend SimdFloat operator|(SimdFloat a, SimdFloat b) { return {_mm_or_ps(a.v, b.v)}; }
+    friend SimdFloat abs(SimdFloat a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+    friend SimdFloat lessThan(SimdFloat a, SimdFloat b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    int signs() const { return _mm_movemask_ps(v); }
+    __m128 quarter(uint32_t) const { return v; }
+#endif
+};
+
+// columns[c][r] holds element r of column c for every lane, lane k is
+// written to matrices[k]. Transposed 4 lanes at a time
+inline void storeMatrices(const SimdFloat (&columns)[4][4], glm::mat4 *matrices)
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        for (uint32_t quarter = 0; quarter < TRANSFORM_SIMD_WIDTH / 4; ++quarter)
+        {
+            __m128 r0 = columns[c][0].quarter(quarter), r1 = columns[c][1].quarter(quarter);
+            __m128 r2 = columns[c][2].quarter(quarter), r3 = columns[c][3].quarter(quarter);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            auto first = matrices + quarter * 4;
+            _mm_storeu_ps(&first[0][c][0], r0);
+            _mm_storeu_ps(&first[1][c][0], r1);
+            _mm_storeu_ps(&first[2][c][0], r2);
+            _mm_storeu_ps(&first[3][c][0], r3);
+        }
+    }
+}
+
+#endif
+
+// Same results as composeTransformsScalar, TRANSFORM_SIMD_WIDTH objects at a
+// time. The remainder goes through the scalar version
+inline void composeTransforms(const TransformStore &store, uint32_t begin, uint32_t end,
+                              glm::mat4 *matrices, BoxBounds &worldBounds)
+{
+    uint32_t i = begin;
+#ifdef TRANSFORM_SIMD_WIDTH
+    auto zero = SimdFloat::broadcast(0.0f), one = SimdFloat::broadcast(1.0f), two = SimdFloat::broadcast(2.0f);
+
+    for (; i + TRANSFORM_SIMD_WIDTH <= end; i += TRANSFORM_SIMD_WIDTH)
+    {
+        auto x = SimdFloat::load(&store.rotationX[i]), y = SimdFloat::load(&store.rotationY[i]);
+        auto z = SimdFloat::load(&store.rotationZ[i]), w = SimdFloat::load(&store.rotationW[i]);
+        auto s = SimdFloat::load(&store.scale[i]);
+        auto twoS = two * s;
+
+        auto xx = x * x, yy = y * y, zz = z * z;
+        auto xy = x * y, xz = x * z, yz = y * z;
+        auto wx = w * x, wy = w * y, wz = w * z;
+
+        // The scaled rotation matrix as glm::mat3_cast builds it
+        SimdFloat columns[4][4] = {
+            {(one - two * (yy + zz)) * s, twoS * (xy + wz), twoS * (xz - wy), zero},
+            {twoS * (xy - wz), (one - two * (xx + zz)) * s, twoS * (yz + wx), zero},
+            {twoS * (xz + wy), twoS * (yz - wx), (one - two * (xx + yy)) * s, zero},
+            {SimdFloat::load(&store.position.x[i]), SimdFloat::load(&store.position.y[i]), SimdFloat::load(&store.position.z[i]), one},
+        };
+        storeMatrices(columns, matrices + i);
+
+        auto cx = SimdFloat::load(&store.localBounds.center.x[i]);
+        auto cy = SimdFloat::load(&store.localBounds.center.y[i]);
+        auto cz = SimdFloat::load(&store.localBounds.center.z[i]);
+        auto ex = SimdFloat::load(&store.localBounds.extent.x[i]);
+        auto ey = SimdFloat::load(&store.localBounds.extent.y[i]);
+        auto ez = SimdFloat::load(&store.localBounds.extent.z[i]);
+
+        (columns[0][0] * cx + columns[1][0] * cy + columns[2][0] * cz + columns[3][0]).store(&worldBounds.center.x[i]);
+        (columns[0][1] * cx + columns[1][1] * cy + columns[2][1] * cz + columns[3][1]).store(&worldBounds.center.y[i]);
+        (columns[0][2] * cx + columns[1][2] * cy + columns[2][2] * cz + columns[3][2]).store(&worldBounds.center.z[i]);
+        (abs(columns[0][0]) * ex + abs(columns[1][0]) * ey + abs(columns[2][0]) * ez).store(&worldBounds.extent.x[i]);
+        (abs(columns[0][1]) * ex + abs(columns[1][1]) * ey + abs(columns[2][1]) * ez).store(&worldBounds.extent.y[i]);
+        (abs(columns[0][2]) * ex + abs(columns[1][2]) * ey + abs(columns[2][2]) * ez).store(&worldBounds.extent.z[i]);
+    }
+#endif
+    composeTransformsScalar(store, i, end, matrices, worldBounds);
+}
+
+// Same results as cullBoxesScalar, TRANSFORM_SIMD_WIDTH boxes at a time
+inline void cullBoxes(const BoxBounds &bounds, const Frustum &frustum, uint32_t begin, uint32_t end, uint8_t *visible)
+{
+    uint32_t i = begin;
+#ifdef TRANSFORM_SIMD_WIDTH
+    auto zero = SimdFloat::broadcast(0.0f);
+
+    for (; i + TRANSFORM_SIMD_WIDTH <= end; i += TRANSFORM_SIMD_WIDTH)
+    {
+        auto cx = SimdFloat::load(&bounds.center.x[i]), cy = SimdFloat::load(&bounds.center.y[i]);
+        auto cz = SimdFloat::load(&bounds.center.z[i]);
+        auto ex = SimdFloat::load(&bounds.extent.x[i]), ey = SimdFloat::load(&bounds.extent.y[i]);
+        auto ez = SimdFloat::load(&bounds.extent.z[i]);
+
+        // Outside when the whole box is behind any one plane
+        auto outside = zero;
+        for (auto &plane : frustum.planes)
+        {
+            auto distance = SimdFloat::broadcast(plane.x) * cx + SimdFloat::broadcast(plane.y) * cy +
+                            SimdFloat::broadcast(plane.z) * cz + SimdFloat::broadcast(plane.w);
+            auto radius = SimdFloat::broadcast(std::abs(plane.x)) * ex + SimdFloat::broadcast(std::abs(plane.y)) * ey +
+                          SimdFloat::broadcast(std::abs(plane.z)) * ez;
+            outside = outside | lessThan(distance + radius, zero);
+        }
+
+        int signs = outside.signs();
+        for (uint32_t lane = 0; lane < TRANSFORM_SIMD_WIDTH; ++lane)
+        {
+            visible[i + lane] = !(signs >> lane & 1);
+        }
+    }
+#endif
+    cullBoxesScalar(bounds, frustum, i, end, visible);
+}
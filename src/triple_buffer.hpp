@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer. The producer
+// always has a slot to write into and never blocks, the consumer always sees
+// the most recently published slot and skips any it was too slow to read.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Producer side
+    T &back()
+    {
+        return slots[backIndex];
+    }
+
+    void publish()
+    {
+        uint8_t expected = shared.load(std::memory_order_relaxed);
+        while (!shared.compare_exchange_weak(
+            expected, (expected & CLOSED) | FRESH | backIndex,
+            std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+        }
+        backIndex = expected & INDEX_MASK;
+        shared.notify_one();
+    }
+
+    // Wakes the consumer, acquire returns false once the last published slot
+    // has been consumed
+    void close()
+    {
+        shared.fetch_or(CLOSED, std::memory_order_acq_rel);
+        shared.notify_all();
+    }
+
+    // Consumer side
+    const T &front() const
+    {
+        return slots[frontIndex];
+    }
+
+    // Blocks until a slot newer than front is published
+    bool acquire()
+    {
+        uint8_t current = shared.load(std::memory_order_acquire);
+        while (!(current & (FRESH | CLOSED)))
+        {
+            shared.wait(current, std::memory_order_acquire);
+            current = shared.load(std::memory_order_acquire);
+        }
+
+        if (!(current & FRESH))
+        {
+            return false;
+        }
+
+        while (!shared.compare_exchange_weak(
+            current, (current & CLOSED) | frontIndex,
+            std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+        }
+        frontIndex = current & INDEX_MASK;
+        return true;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0b0011;
+    static constexpr uint8_t FRESH = 0b0100;
+    static constexpr uint8_t CLOSED = 0b1000;
+
+    std::array<T, 3> slots{};
+
+    uint8_t frontIndex = 0;
+    std::atomic<uint8_t> shared{1};
+    uint8_t backIndex = 2;
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#define VULKAN_HPP_NO_CONSTRUCTORS
+
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "aggregate_reflection.hpp"
+
+// Quantized attribute storage. Each is a distinct type so it maps to exactly
+// one vertex input format
+struct Half4
+{
+    glm::u16vec4 bits;
+};
+
+struct Snorm16x4
+{
+    glm::i16vec4 value;
+};
+
+struct Unorm8x4
+{
+    glm::u8vec4 value;
+};
+
+// Vertex input format of an attribute type, unsupported types don't compile.
+// Types spanning several locations (matrices) also define locations
+template <typename T>
+struct VertexAttributeFormat;
+
+template <>
+struct VertexAttributeFormat<float>
+{
+    static constexpr vk::Format value = vk::Format::eR32Sfloat;
+};
+
+template <>
+struct VertexAttributeFormat<glm::vec2>
+{
+    static constexpr vk::Format value = vk::Format::eR32G32Sfloat;
+};
+
+template <>
+struct VertexAttributeFormat<glm::vec3>
+{
+    static constexpr vk::Format value = vk::Format::eR32G32B32Sfloat;
+};
+
+template <>
+struct VertexAttributeFormat<glm::vec4>
+{
+    static constexpr vk::Format value = vk::Format::eR32G32B32A32Sfloat;
+};
+
+template <>
+struct VertexAttributeFormat<Half4>
+{
+    static constexpr vk::Format value = vk::Format::eR16G16B16A16Sfloat;
+};
+
+template <>
+struct VertexAttributeFormat<Snorm16x4>
+{
+    static constexpr vk::Format value = vk::Format::eR16G16B16A16Snorm;
+};
+
+template <>
+struct VertexAttributeFormat<Unorm8x4>
+{
+    static constexpr vk::Format value = vk::Format::eR8G8B8A8Unorm;
+};
+
+template <>
+struct VertexAttributeFormat<glm::mat4>
+{
+    static constexpr vk::Format value = vk::Format::eR32G32B32A32Sfloat;
+    static constexpr uint32_t locations = 4;
+};
+
+template <typename T>
+constexpr uint32_t vertexAttributeLocations()
+{
+    if constexpr (requires { VertexAttributeFormat<T>::locations; })
+    {
+        return VertexAttributeFormat<T>::locations;
+    }
+    else
+    {
+        return 1;
+    }
+}
+
+// Per vertex unless the struct declares INPUT_RATE
+template <typename Struct>
+constexpr vk::VertexInputRate vertexInputRate()
+{
+    if constexpr (requires { Struct::INPUT_RATE; })
+    {
+        return Struct::INPUT_RATE;
+    }
+    else
+    {
+        return vk::VertexInputRate::eVertex;
+    }
+}
+
+template <typename... Fields>
+constexpr uint32_t vertexLocationCount(TypeList<Fields...>)
+{
+    return (vertexAttributeLocations<Fields>() + ... + 0);
+}
+
+template <typename Struct>
+constexpr uint32_t vertexLocationCount()
+{
+    return vertexLocationCount(AggregateFields<Struct>{});
+}
+
+// One attribute per location of every field of Struct, reflected at compile
+// time. Locations are assigned in field order starting at firstLocation
+template <typename Struct>
+constexpr auto vertexAttributeDescriptions(uint32_t binding, uint32_t firstLocation)
+{
+    constexpr auto offsets = aggregateFieldOffsets<Struct>();
+
+    std::array<vk::VertexInputAttributeDescription, vertexLocationCount<Struct>()> attributes{};
+    size_t index = 0, field = 0;
+    uint32_t location = firstLocation;
+
+    auto addField = [&]<typename Field>(TypeList<Field>)
+    {
+        constexpr uint32_t locations = vertexAttributeLocations<Field>();
+        for (uint32_t i = 0; i < locations; ++i)
+        {
+            attributes[index++] = {
+                .location = location++,
+                .binding = binding,
+                .format = VertexAttributeFormat<Field>::value,
+                .offset = static_cast<uint32_t>(offsets[field] + i * sizeof(Field) / locations),
+            };
+        }
+        ++field;
+    };
+    [&]<typename... Fields>(TypeList<Fields...>)
+    {
+        (addField(TypeList<Fields>{}), ...);
+    }(AggregateFields<Struct>{});
+
+    return attributes;
+}
+
+// Vertex input state for a pipeline reading one binding per struct, in order.
+// Attribute locations continue from one binding to the next
+template <typename... Bindings>
+struct VertexInputLayout
+{
+    static constexpr std::array<vk::VertexInputBindingDescription, sizeof...(Bindings)> bindings = []
+    {
+        std::array<vk::VertexInputBindingDescription, sizeof...(Bindings)> bindings{};
+        uint32_t binding = 0;
+        ((bindings[binding] = {
+              .binding = binding,
+              .stride = sizeof(Bindings),
+              .inputRate = vertexInputRate<Bindings>(),
+          },
+          ++binding),
+         ...);
+        return bindings;
+    }();
+
+    static constexpr std::array<vk::VertexInputAttributeDescription, (vertexLocationCount<Bindings>() + ...)> attributes = []
+    {
+        std::array<vk::VertexInputAttributeDescription, (vertexLocationCount<Bindings>() + ...)> attributes{};
+        size_t index = 0;
+        uint32_t binding = 0, location = 0;
+        auto append = [&]<typename Binding>(TypeList<Binding>)
+        {
+            for (auto &attribute : vertexAttributeDescriptions<Binding>(binding, location))
+            {
+                attributes[index++] = attribute;
+            }
+            location += vertexLocationCount<Binding>();
+            ++binding;
+        };
+        (append(TypeList<Bindings>{}), ...);
+        return attributes;
+    }();
+
+    static vk::PipelineVertexInputStateCreateInfo createInfo()
+    {
+        return {
+            .vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size()),
+            .pVertexBindingDescriptions = bindings.data(),
+            .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+            .pVertexAttributeDescriptions = attributes.data(),
+        };
+    }
+};
+
+// Maps positions into [-1, 1] on every axis for normalized storage. The
+// inverse is folded into the model matrix instead of the vertex shader
+struct PositionQuantization
+{
+    glm::vec3 center{0.0f};
+    glm::vec3 halfExtent{1.0f};
+
+    static PositionQuantization fit(std::span<const glm::vec3> positions)
+    {
+        if (positions.empty())
+        {
+            return {};
+        }
+
+        glm::vec3 min = positions.front(), max = positions.front();
+        for (auto &position : positions)
+        {
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+
+        // Flat axes keep a unit extent rather than dividing by zero
+        auto halfExtent = (max - min) * 0.5f;
+        return {
+            .center = (min + max) * 0.5f,
+            .halfExtent = glm::mix(halfExtent, glm::vec3(1.0f), glm::equal(halfExtent, glm::vec3(0.0f))),
+        };
+    }
+
+    glm::vec3 quantize(glm::vec3 position) const
+    {
+        return (position - center) / halfExtent;
+    }
+
+    glm::mat4 dequantize() const
+    {
+        return glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+    }
+};
+
+// Full precision, 24 bytes. Meshes are authored in this layout
+struct Vertex
+{
+    glm::vec3 pos;
+    glm::vec3 color;
+
+    static constexpr bool NORMALIZED_POSITIONS = false;
+
+    static Vertex pack(const Vertex &vertex, const PositionQuantization &)
+    {
+        return vertex;
+    }
+};
+
+// 12 bytes, half float positions keep about three significant digits
+struct HalfVertex
+{
+    Half4 pos;
+    Unorm8x4 color;
+
+    static constexpr bool NORMALIZED_POSITIONS = false;
+
+    static HalfVertex pack(const Vertex &vertex, const PositionQuantization &)
+    {
+        return {
+            .pos = {glm::packHalf(glm::vec4(vertex.pos, 1.0f))},
+            .color = {glm::packUnorm<glm::uint8>(glm::vec4(vertex.color, 1.0f))},
+        };
+    }
+};
+
+// 12 bytes, positions evenly spaced over the mesh bounds (1/65535 of its size)
+struct Snorm16Vertex
+{
+    Snorm16x4 pos;
+    Unorm8x4 color;
+
+    static constexpr bool NORMALIZED_POSITIONS = true;
+
+    static Snorm16Vertex pack(const Vertex &vertex, const PositionQuantization &quantization)
+    {
+        return {
+            .pos = {glm::packSnorm<glm::int16>(glm::vec4(quantization.quantize(vertex.pos), 1.0f))},
+            .color = {glm::packUnorm<glm::uint8>(glm::vec4(vertex.color, 1.0f))},
+        };
+    }
+};
+
+template <typename PackedVertex>
+struct PackedMesh
+{
+    std::vector<PackedVertex> vertices;
+
+    // Multiply into the model matrix to get back the original positions
+    glm::mat4 dequantize{1.0f};
+};
+
+template <typename PackedVertex>
+PackedMesh<PackedVertex> packVertices(std::span<const Vertex> vertices)
+{
+    PositionQuantization quantization;
+    if constexpr (PackedVertex::NORMALIZED_POSITIONS)
+    {
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (auto &vertex : vertices)
+        {
+            positions.push_back(vertex.pos);
+        }
+        quantization = PositionQuantization::fit(positions);
+    }
+
+    PackedMesh<PackedVertex> mesh;
+    mesh.vertices.reserve(vertices.size());
+    for (auto &vertex : vertices)
+    {
+        mesh.vertices.push_back(PackedVertex::pack(vertex, quantization));
+    }
+    mesh.dequantize = quantization.dequantize();
+    return mesh;
+}
+
+// Per object data, read as a per instance vertex attribute
+struct InstanceData
+{
+    glm::mat4 model;
+
+    static constexpr vk::VertexInputRate INPUT_RATE = vk::VertexInputRate::eInstance;
+};